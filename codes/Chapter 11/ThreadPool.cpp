@@ -1,47 +1,1064 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 using namespace std;
 
+// A move-only void() callable. Callables up to INLINE_SIZE bytes that move
+// without throwing live inside the Task itself, so wrapping a lambda does not
+// allocate; larger ones fall back to the heap. Unlike function<void()> the
+// callable need not be copyable, so it may own a unique_ptr.
+class Task {
+ public:
+  static const size_t INLINE_SIZE = 64;
+
+  Task() : _ops(nullptr) {}
+
+  template <typename F,
+            typename = typename enable_if<
+                !is_same<typename decay<F>::type, Task>::value>::type>
+  Task(F &&func) {
+    typedef typename decay<F>::type Func;
+    init<Func>(std::forward<F>(func), IsInline<Func>());
+  }
+
+  Task(Task &&other) noexcept : _ops(other._ops) {
+    if (_ops != nullptr) _ops->move(other._storage, _storage);
+    other._ops = nullptr;
+  }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this == &other) return *this;
+    reset();
+    _ops = other._ops;
+    if (_ops != nullptr) _ops->move(other._storage, _storage);
+    other._ops = nullptr;
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { reset(); }
+
+  void operator()() { _ops->call(_storage); }
+
+  explicit operator bool() const { return _ops != nullptr; }
+
+ private:
+  struct Ops {
+    void (*call)(void *storage);
+    void (*move)(void *from, void *to);  // Leaves from empty
+    void (*destroy)(void *storage);
+  };
+
+  template <typename F>
+  struct IsInline
+      : integral_constant<bool, sizeof(F) <= INLINE_SIZE &&
+                                    alignof(F) <= alignof(max_align_t) &&
+                                    is_nothrow_move_constructible<F>::value> {};
+
+  // The callable stored in place
+  template <typename F>
+  struct Inline {
+    static void call(void *storage) { (*(F *)storage)(); }
+    static void move(void *from, void *to) {
+      new (to) F(std::move(*(F *)from));
+      ((F *)from)->~F();
+    }
+    static void destroy(void *storage) { ((F *)storage)->~F(); }
+    static const Ops ops;
+  };
+
+  // A pointer to the callable stored in place
+  template <typename F>
+  struct Heap {
+    static void call(void *storage) { (**(F **)storage)(); }
+    static void move(void *from, void *to) { *(F **)to = *(F **)from; }
+    static void destroy(void *storage) { delete *(F **)storage; }
+    static const Ops ops;
+  };
+
+  const Ops *_ops;
+  alignas(max_align_t) char _storage[INLINE_SIZE];
+
+  template <typename F, typename Arg>
+  void init(Arg &&func, true_type) {
+    new (_storage) F(std::forward<Arg>(func));
+    _ops = &Inline<F>::ops;
+  }
+
+  template <typename F, typename Arg>
+  void init(Arg &&func, false_type) {
+    *(F **)_storage = new F(std::forward<Arg>(func));
+    _ops = &Heap<F>::ops;
+  }
+
+  void reset() {
+    if (_ops != nullptr) _ops->destroy(_storage);
+    _ops = nullptr;
+  }
+};
+
+template <typename F>
+const Task::Ops Task::Inline<F>::ops = {&call, &move, &destroy};
+
+template <typename F>
+const Task::Ops Task::Heap<F>::ops = {&call, &move, &destroy};
+
+struct ThreadOptions {
+  ThreadOptions() : cpu(-1), stackSize(0) {}
+
+  string name;       // Shown by top, perf and gdb; cut to 15 characters
+  int cpu;           // Pin to this CPU, or -1 to run anywhere
+  size_t stackSize;  // 0 for the system default
+};
+
+// Built on pthreads directly, since std::thread can neither pin a thread
+// before it starts nor choose its stack size
 class Thread {
  public:
-  Thread(function<void()> func) : _func(func) {}
+  Thread(Task func, const ThreadOptions &options = ThreadOptions())
+      : _func(std::move(func)), _options(options), _started(false) {}
+
+  ~Thread() { join(); }
+
+  void start() {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (_options.stackSize > 0) {
+      pthread_attr_setstacksize(&attr, _options.stackSize);
+    }
+    if (_options.cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(_options.cpu, &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int error = pthread_create(&_tid, &attr, &Thread::run, this);
+    pthread_attr_destroy(&attr);
+    if (error != 0) throw "failed to create thread!";
+    _started = true;
+    if (!_options.name.empty()) {
+      pthread_setname_np(_tid, _options.name.substr(0, 15).c_str());
+    }
+  }
 
-  thread start() {
-    thread t(_func);
-    return t;
+  void join() {
+    if (!_started) return;
+    pthread_join(_tid, nullptr);
+    _started = false;
   }
 
  private:
-  function<void()> _func;
+  Task _func;
+  ThreadOptions _options;
+  pthread_t _tid;
+  bool _started;
+
+  static void *run(void *arg) {
+    ((Thread *)arg)->_func();
+    return nullptr;
+  }
 };
 
+// Parses a kernel CPU list such as "0-3,8-11"
+vector<int> parseCpuList(const string &list) {
+  vector<int> cpus;
+  int first = -1, value = -1;
+  for (size_t i = 0; i <= list.size(); i++) {
+    char c = i < list.size() ? list[i] : ',';
+    if (c >= '0' && c <= '9') {
+      value = (value < 0 ? 0 : value * 10) + (c - '0');
+    } else if (c == '-') {
+      first = value;
+      value = -1;
+    } else if (value >= 0) {
+      for (int cpu = first < 0 ? value : first; cpu <= value; cpu++) {
+        cpus.push_back(cpu);
+      }
+      first = value = -1;
+    }
+  }
+  return cpus;
+}
+
+// The CPUs this process may use, grouped by NUMA node. Machines without NUMA
+// information come back as a single node.
+vector<vector<int>> numaNodes() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+
+  vector<vector<int>> nodes;
+  for (int node = 0;; node++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    ifstream in(path);
+    if (!in) break;
+    string list;
+    getline(in, list);
+    vector<int> cpus;
+    for (int cpu : parseCpuList(list)) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    if (!cpus.empty()) nodes.push_back(cpus);
+  }
+
+  if (nodes.empty()) {
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+// Latency-sensitive tasks go ahead of bulk work
+enum TaskClass { INTERACTIVE, BATCH, TASK_CLASSES };
+
+// Workers are spread evenly over the NUMA nodes, and each node keeps its own
+// task queues. A worker serves its own node first and only takes work from
+// other nodes when its node has none, so tasks and the memory they touch tend
+// to stay on one node.
+//
+// The pool starts with the workers given to startPool() and never drops below
+// that. If setMaxSize() allows more, a monitor thread adds a worker whenever
+// a task has waited longer than the spawn wait with no worker free, and added
+// workers exit again after the idle timeout. An elastic pool may start with
+// no workers at all.
 class ThreadPool {
  public:
-  ThreadPool() {}
+  typedef chrono::steady_clock Clock;
+
+  ThreadPool()
+      : _running(false),
+        _stopped(false),
+        _seq(0),
+        _maxWait(chrono::milliseconds(100)),
+        _name("pool"),
+        _stackSize(0),
+        _pinned(false),
+        _minSize(0),
+        _maxSize(0),
+        _workers(0),
+        _spawnWait(chrono::milliseconds(10)),
+        _idleTimeout(chrono::seconds(10)) {
+    for (int i = 0; i < TASK_CLASSES; i++) {
+      _reserved[i] = 0;
+    }
+  }
 
   ~ThreadPool() {
-    for (int i = 0; i < _pool.size(); i++) {
-      delete _pool[i];
+    stop();
+    for (int i = 0; i < (int)_pool.size(); i++) {
+      delete _pool[i];  // Slots never used are null
     }
   }
+
+  // Dedicate count workers to one class, so it always has threads available
+  // however much of the other class is queued. Call before startPool().
+  void reserve(TaskClass cls, int count) { _reserved[cls] = count; }
+
+  // A batch task that has waited this long runs before newer interactive
+  // tasks, so a steady stream of interactive work cannot starve it
+  void setMaxWait(Clock::duration wait) { _maxWait = wait; }
+
+  // Workers are named "<name>-<id>". Call before startPool().
+  void setName(const string &name) { _name = name; }
+
+  void setStackSize(size_t size) { _stackSize = size; }
+
+  // Pin each worker to one CPU of its node instead of letting it float
+  void setPinned(bool pinned) { _pinned = pinned; }
+
+  // Upper bound for the elastic pool. Call before startPool().
+  void setMaxSize(int size) { _maxSize = size; }
+
+  // How long a task may wait with every worker busy before another is added
+  void setSpawnWait(Clock::duration wait) { _spawnWait = wait; }
+
+  // How long an added worker stays idle before it exits
+  void setIdleTimeout(Clock::duration timeout) { _idleTimeout = timeout; }
+
+  int nodeCount() const { return _nodes.size(); }
+
+  int size() const { return _workers; }
+
+  // Run a call that may block, e.g. on I/O, from inside a task. Before it
+  // blocks, another worker is added if work is queued and none is free, so
+  // blocked workers do not hold up the rest of the queue. A blocked worker is
+  // not idle, so starved() already counts it as unavailable.
+  template <typename F>
+  void blocking(F &&func) {
+    if (currentPool() == this && starved()) spawn();
+    func();
+  }
+
   void startPool(int size) {
-    for (int i = 0; i < size; i++) {
-      _pool.push_back(new Thread(bind(&ThreadPool::runInThread, this, i)));
+    int reserved = 0;
+    for (int i = 0; i < TASK_CLASSES; i++) {
+      reserved += _reserved[i];
+    }
+    if (reserved > size) throw "too many reserved workers!";
+    // With no shared workers, every class needs a reserved one of its own
+    if (reserved == max(size, _maxSize)) {
+      for (int i = 0; i < TASK_CLASSES; i++) {
+        if (_reserved[i] == 0) throw "no worker can run a task class!";
+      }
+    }
+
+    vector<vector<int>> cpus = numaNodes();
+    for (const vector<int> &list : cpus) {
+      _nodes.emplace_back(new Node());
+      _nodes.back()->cpus = list;
+    }
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+      _cpuNode.push_back(-1);
+    }
+    for (int node = 0; node < (int)cpus.size(); node++) {
+      for (int cpu : cpus[node]) {
+        _cpuNode[cpu] = node;
+      }
+    }
+
+    // Every slot exists up front, so workers never see these vectors move
+    _minSize = size;
+    _maxSize = max(_maxSize, size);
+    _pool.assign(_maxSize, nullptr);
+    for (int i = 0; i < _maxSize; i++) {
+      _workerNode.push_back(i % _nodes.size());
+    }
+    for (int i = _maxSize - 1; i >= size; i--) {
+      _freeSlots.push_back(i);
     }
 
+    _running = true;
+    lock_guard<mutex> lock(_poolMutex);
     for (int i = 0; i < size; i++) {
-      _handler.push_back(_pool[i]->start());
+      startWorker(i);
+    }
+    _workers = size;
+    if (_maxSize > size) {
+      ThreadOptions options;
+      options.name = _name + "-monitor";
+      _monitor.reset(new Thread([this] { monitor(); }, options));
+      _monitor->start();
     }
+  }
+
+  // Tasks of a class run earliest deadline first; tasks without a deadline
+  // run in submission order after those with one. They are queued on the
+  // given node, or on the node of the calling CPU when node is -1.
+  void submit(Task func, TaskClass cls = BATCH,
+              Clock::time_point deadline = Clock::time_point::max(),
+              int node = -1) {
+    if (_nodes.empty()) throw "pool is not started!";
+    if (_stopped) throw "pool is stopped!";
+    if (node < 0 || node >= (int)_nodes.size()) node = currentNode();
+    Node &target = *_nodes[node];
+    bool idle;
+    {
+      lock_guard<mutex> lock(target.guard);
+      Clock::time_point now = Clock::now();
+      if (cls == BATCH) {
+        deadline = min(deadline, now + _maxWait);
+      }
+      vector<ScheduledTask> &queue = target.queues[cls];
+      queue.push_back(ScheduledTask{std::move(func), deadline, now, _seq++});
+      push_heap(queue.begin(), queue.end(), Later());
+      idle = target.canRun(cls);
+    }
+    target.cv[cls].notify_one();
+    target.cv[TASK_CLASSES].notify_one();
+    if (idle) return;
+    // Nobody on that node is free, so wake a worker elsewhere to take it.
+    // If there is none, the monitor adds one once the task has waited.
+    for (unique_ptr<Node> &other : _nodes) {
+      if (other.get() != &target && other->canRun(cls)) {
+        other->cv[cls].notify_one();
+        other->cv[TASK_CLASSES].notify_one();
+        return;
+      }
+    }
+  }
 
-    for (thread &t : _handler) {
-      t.join();
+  // Run everything already submitted, then join the workers. Tasks may
+  // still submit more while this runs; submit() throws once it returns.
+  void stop() {
+    {
+      // Taken so that no worker is being spawned meanwhile
+      lock_guard<mutex> lock(_poolMutex);
+      if (!_running.exchange(false)) return;
+      _monitorCv.notify_all();
+    }
+    if (_monitor) _monitor->join();
+    for (unique_ptr<Node> &node : _nodes) {
+      lock_guard<mutex> lock(node->guard);
+      for (int i = 0; i <= TASK_CLASSES; i++) {
+        node->cv[i].notify_all();
+      }
     }
+    for (Thread *t : _pool) {
+      if (t != nullptr) t->join();
+    }
+    // Workers of a class may all have left before another task queued work
+    // for it, so run whatever is left here
+    ScheduledTask task;
+    for (int i = 0; i < (int)_nodes.size(); i++) {
+      while (true) {
+        {
+          lock_guard<mutex> lock(_nodes[i]->guard);
+          if (!take(*_nodes[i], TASK_CLASSES, task)) break;
+        }
+        task.func();
+        i = 0;  // The task may have queued more anywhere
+      }
+    }
+    _stopped = true;
   }
 
  private:
+  struct ScheduledTask {
+    Task func;
+    Clock::time_point deadline;
+    Clock::time_point queued;
+    unsigned long seq;
+  };
+
+  // Heap order: the earliest deadline on top, ties in submission order
+  struct Later {
+    bool operator()(const ScheduledTask &a, const ScheduledTask &b) const {
+      if (a.deadline != b.deadline) return a.deadline > b.deadline;
+      return a.seq > b.seq;
+    }
+  };
+
+  struct Node {
+    Node() {
+      for (int i = 0; i <= TASK_CLASSES; i++) {
+        idle[i] = 0;
+      }
+    }
+
+    // Whether a waiting worker could take a task of this class
+    bool canRun(TaskClass cls) const {
+      return idle[cls] > 0 || idle[TASK_CLASSES] > 0;
+    }
+
+    vector<int> cpus;
+    mutex guard;
+    // One per class for reserved workers, the last one for shared workers
+    condition_variable cv[TASK_CLASSES + 1];
+    vector<ScheduledTask> queues[TASK_CLASSES];
+    atomic<int> idle[TASK_CLASSES + 1];  // Waiting workers, by role
+  };
+
+  // Idle workers look at other nodes this often, in case a wakeup was missed
+  enum { STEAL_INTERVAL_MS = 5 };
+  static const size_t QUEUE_RESERVE = 1024;
+
   vector<Thread *> _pool;
-  vector<thread> _handler;
-  void runInThread(int id) { cout << "Thread " << id << endl; }
+  vector<unique_ptr<Node>> _nodes;
+  vector<int> _workerNode;
+  vector<int> _cpuNode;
+  int _reserved[TASK_CLASSES];
+  atomic<bool> _running;
+  atomic<bool> _stopped;
+  atomic<unsigned long> _seq;
+  Clock::duration _maxWait;
+  string _name;
+  size_t _stackSize;
+  bool _pinned;
+  int _minSize;
+  int _maxSize;
+  atomic<int> _workers;
+  Clock::duration _spawnWait;
+  Clock::duration _idleTimeout;
+  mutex _poolMutex;        // Guards _pool and _freeSlots once started
+  vector<int> _freeSlots;  // Slots with no live worker
+  unique_ptr<Thread> _monitor;
+  condition_variable _monitorCv;  // Wakes the monitor on stop()
+
+  static ThreadPool *&currentPool() {
+    thread_local ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  // Called with _poolMutex held. A slot whose worker has exited is joined
+  // before it is reused.
+  void startWorker(int id) {
+    int node = _workerNode[id];
+    const vector<int> &nodeCpus = _nodes[node]->cpus;
+    ThreadOptions options;
+    options.name = _name + "-" + to_string(id);
+    options.stackSize = _stackSize;
+    if (_pinned) {
+      options.cpu = nodeCpus[id / _nodes.size() % nodeCpus.size()];
+    }
+    delete _pool[id];
+    _pool[id] = new Thread([this, id] { runInThread(id); }, options);
+    _pool[id]->start();
+  }
+
+  // Add a worker unless the pool is at its maximum
+  void spawn() {
+    lock_guard<mutex> lock(_poolMutex);
+    if (!_running || _freeSlots.empty()) return;
+    int id = _freeSlots.back();
+    _freeSlots.pop_back();
+    _workers++;
+    startWorker(id);
+  }
+
+  // Leave the pool if it is above its minimum; reserved workers always stay
+  bool retire(int id) {
+    if (roleOf(id) != TASK_CLASSES) return false;
+    int workers = _workers;
+    while (workers > _minSize) {
+      if (_workers.compare_exchange_weak(workers, workers - 1)) {
+        lock_guard<mutex> lock(_poolMutex);
+        _freeSlots.push_back(id);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether some class has work queued but no waiting worker to take it
+  bool starved() {
+    for (int i = 0; i < TASK_CLASSES; i++) {
+      bool queued = false, idle = false;
+      for (unique_ptr<Node> &node : _nodes) {
+        idle = idle || node->canRun((TaskClass)i);
+        lock_guard<mutex> lock(node->guard);
+        queued = queued || !node->queues[i].empty();
+      }
+      if (queued && !idle) return true;
+    }
+    return false;
+  }
+
+  // Whether a task has waited longer than the spawn wait for a class that
+  // has no waiting worker. Queues are heaps, so each is searched in full.
+  bool overdue() {
+    Clock::time_point cutoff = Clock::now() - _spawnWait;
+    for (int i = 0; i < TASK_CLASSES; i++) {
+      bool idle = false;
+      for (unique_ptr<Node> &node : _nodes) {
+        idle = idle || node->canRun((TaskClass)i);
+      }
+      if (idle) continue;
+      for (unique_ptr<Node> &node : _nodes) {
+        lock_guard<mutex> lock(node->guard);
+        for (const ScheduledTask &task : node->queues[i]) {
+          if (task.queued < cutoff) return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Runs only in an elastic pool, checking twice per spawn wait so that no
+  // task waits much longer than that before help arrives
+  void monitor() {
+    Clock::duration interval =
+        max<Clock::duration>(_spawnWait / 2, chrono::milliseconds(1));
+    unique_lock<mutex> lock(_poolMutex);
+    while (_running) {
+      _monitorCv.wait_for(lock, interval);
+      if (!_running) return;
+      lock.unlock();
+      if (overdue()) spawn();
+      lock.lock();
+    }
+  }
+
+  int currentNode() const {
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= (int)_cpuNode.size() || _cpuNode[cpu] < 0) return 0;
+    return _cpuNode[cpu];
+  }
+
+  // The first workers are reserved for each class in turn; the rest are
+  // shared and serve both
+  TaskClass roleOf(int id) const {
+    for (int i = 0; i < TASK_CLASSES; i++) {
+      if (id < _reserved[i]) return (TaskClass)i;
+      id -= _reserved[i];
+    }
+    return TASK_CLASSES;
+  }
+
+  // Pick the queue a worker should take from next, or TASK_CLASSES if none
+  static TaskClass choose(const Node &node, TaskClass role) {
+    if (role != TASK_CLASSES) {
+      return node.queues[role].empty() ? TASK_CLASSES : role;
+    }
+    const vector<ScheduledTask> &interactive = node.queues[INTERACTIVE];
+    const vector<ScheduledTask> &batch = node.queues[BATCH];
+    if (batch.empty()) return interactive.empty() ? TASK_CLASSES : INTERACTIVE;
+    if (interactive.empty()) return BATCH;
+    // Overdue batch work wins against interactive work that is due later
+    if (batch.front().deadline <= Clock::now() &&
+        batch.front().deadline < interactive.front().deadline) {
+      return BATCH;
+    }
+    return INTERACTIVE;
+  }
+
+  // Called with node.guard held
+  static bool take(Node &node, TaskClass role, ScheduledTask &task) {
+    TaskClass cls = choose(node, role);
+    if (cls == TASK_CLASSES) return false;
+    vector<ScheduledTask> &queue = node.queues[cls];
+    pop_heap(queue.begin(), queue.end(), Later());
+    task = std::move(queue.back());
+    queue.pop_back();
+    return true;
+  }
+
+  bool steal(int home, TaskClass role, ScheduledTask &task) {
+    for (int i = 1; i < (int)_nodes.size(); i++) {
+      Node &node = *_nodes[(home + i) % _nodes.size()];
+      lock_guard<mutex> lock(node.guard);
+      if (take(node, role, task)) return true;
+    }
+    return false;
+  }
+
+  void runInThread(int id) {
+    TaskClass role = roleOf(id);
+    int home = _workerNode[id];
+    Node &node = *_nodes[home];
+    // The first worker of a node allocates its queues, so the kernel places
+    // that memory on the worker's node
+    if (id < (int)_nodes.size()) {
+      lock_guard<mutex> lock(node.guard);
+      for (int i = 0; i < TASK_CLASSES; i++) {
+        node.queues[i].reserve(QUEUE_RESERVE);
+      }
+    }
+
+    currentPool() = this;
+    while (true) {
+      ScheduledTask task;
+      {
+        unique_lock<mutex> lock(node.guard);
+        Clock::time_point idleSince = Clock::now();
+        while (!take(node, role, task)) {
+          lock.unlock();
+          if (steal(home, role, task)) break;
+          lock.lock();
+          if (take(node, role, task)) break;
+          if (!_running) return;
+          if (Clock::now() - idleSince > _idleTimeout && retire(id)) return;
+          node.idle[role]++;
+          node.cv[role].wait_for(lock,
+                                 chrono::milliseconds(STEAL_INTERVAL_MS));
+          node.idle[role]--;
+        }
+      }
+      // Still falling behind, so bring in help before running this one
+      if (Clock::now() - task.queued > _spawnWait && starved()) spawn();
+      task.func();
+    }
+  }
+};
+
+// Parallel algorithms over vector-like containers such as MyVector: anything
+// with size() and an operator[] into contiguous storage. The calling thread
+// works through the chunks too, so they may also be called from inside a
+// pool task.
+
+// Shared by everyone working on one loop. Helper tasks hold it through a
+// shared_ptr, so a helper that starts after the loop is over finds no chunk
+// left and returns without touching anything else.
+class LoopState {
+ public:
+  LoopState(int n, int grain, int parts, bool fixed)
+      : _n(n),
+        _grain(grain),
+        _parts(parts),
+        _fixed(fixed),
+        _next(0),
+        _done(0),
+        _failed(false) {}
+
+  // Fixed chunks are all grain elements long. Adaptive chunks start at a
+  // share of what is left and shrink towards grain, so early chunks keep
+  // scheduling cheap and late ones even out the finish.
+  bool claim(int &index, int &begin, int &end) {
+    uint64_t cur = _next.load();
+    while (true) {
+      int start = (int)(cur & 0xffffffff);
+      if (start >= _n) return false;
+      int size = _fixed ? _grain : max(_grain, (_n - start) / (2 * _parts));
+      int stop = _n - start > size ? start + size : _n;
+      uint64_t want = ((cur >> 32) + 1) << 32 | (uint32_t)stop;
+      if (_next.compare_exchange_weak(cur, want)) {
+        index = cur >> 32;
+        begin = start;
+        end = stop;
+        return true;
+      }
+    }
+  }
+
+  void finish(int count) {
+    if (_done.fetch_add(count) + count == _n) {
+      lock_guard<mutex> lock(_mutex);
+      _cv.notify_all();
+    }
+  }
+
+  void wait() {
+    unique_lock<mutex> lock(_mutex);
+    while (_done != _n) {
+      _cv.wait(lock);
+    }
+  }
+
+  int chunks() const { return _next.load() >> 32; }
+
+  // Keeps the first exception thrown by the body; chunks claimed after it
+  // are counted as done without being run
+  void fail(exception_ptr error) {
+    lock_guard<mutex> lock(_mutex);
+    if (!_error) _error = error;
+    _failed = true;
+  }
+
+  bool failed() const { return _failed; }
+
+  // Takes the exception out, so the caller is left its only owner
+  void rethrow() {
+    exception_ptr error;
+    swap(error, _error);
+    if (error) rethrow_exception(error);
+  }
+
+ private:
+  const int _n;
+  const int _grain;
+  const int _parts;
+  const bool _fixed;
+  atomic<uint64_t> _next;  // Index of the next chunk << 32 | its start
+  atomic<int> _done;       // Elements in finished chunks
+  atomic<bool> _failed;
+  exception_ptr _error;
+  mutex _mutex;
+  condition_variable _cv;
+};
+
+template <typename Body>
+void runChunks(LoopState &state, Body &body) {
+  int index, begin, end;
+  while (state.claim(index, begin, end)) {
+    if (!state.failed()) {
+      try {
+        body(index, begin, end);
+      } catch (...) {
+        state.fail(current_exception());
+      }
+    }
+    state.finish(end - begin);
+  }
+}
+
+// Call body(index, begin, end) for chunks covering [0, n) on the pool and
+// the calling thread, and return the number of chunks. Chunks are numbered in
+// the order of their ranges. Helpers use body until every chunk is done, so
+// this always waits for them; the first exception the body threw anywhere is
+// rethrown after that.
+template <typename Body>
+int parallelChunks(ThreadPool &pool, int n, int grain, bool fixed,
+                   Body &body) {
+  if (n <= 0) return 0;
+  grain = max(grain, 1);
+  int chunks = (n - 1) / grain + 1;
+  int parts = min(pool.size() + 1, chunks);
+  shared_ptr<LoopState> state =
+      make_shared<LoopState>(n, grain, parts, fixed);
+  Body *pbody = &body;
+  for (int i = 1; i < parts; i++) {
+    try {
+      pool.submit([state, pbody] { runChunks(*state, *pbody); });
+    } catch (...) {
+      break;  // The calling thread runs whatever the helpers don't
+    }
+  }
+  runChunks(*state, body);
+  state->wait();
+  state->rethrow();
+  return state->chunks();
+}
+
+// Enough chunks per thread that uneven ones even out, but never so few
+// elements that scheduling costs more than the work
+inline int grainSize(ThreadPool &pool, int n, int minGrain = 4096) {
+  return max(minGrain, n / (8 * (pool.size() + 1)));
+}
+
+// A grain that depends only on n, so results do not change with pool size
+inline int fixedGrainSize(int n, int minGrain = 4096) {
+  const int MAX_BLOCKS = 256;
+  return max(minGrain, (n - 1) / MAX_BLOCKS + 1);
+}
+
+template <typename Vec>
+using ElementOf =
+    typename remove_reference<decltype(declval<Vec &>()[0])>::type;
+
+// func(element) for every element
+template <typename Vec, typename F>
+void parallel_for(ThreadPool &pool, Vec &vec, F func, int grain = 0) {
+  int n = vec.size();
+  if (n == 0) return;
+  ElementOf<Vec> *data = &vec[0];
+  auto body = [data, &func](int, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      func(data[i]);
+    }
+  };
+  parallelChunks(pool, n, grain > 0 ? grain : grainSize(pool, n), false,
+                 body);
+}
+
+// out[i] = func(in[i]); out must already hold at least in.size() elements
+template <typename In, typename Out, typename F>
+void parallel_transform(ThreadPool &pool, In &in, Out &out, F func,
+                        int grain = 0) {
+  int n = in.size();
+  if (n == 0) return;
+  if ((int)out.size() < n) throw "output is too small!";
+  ElementOf<In> *src = &in[0];
+  ElementOf<Out> *dst = &out[0];
+  auto body = [src, dst, &func](int, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      dst[i] = func(src[i]);
+    }
+  };
+  parallelChunks(pool, n, grain > 0 ? grain : grainSize(pool, n), false,
+                 body);
+}
+
+// One chunk's result, on a cache line of its own. Unlike vector<bool>, a
+// vector of these lets every chunk write its result without a race.
+template <typename T>
+struct alignas(64) Partial {
+  T value;
 };
+
+// init combined with every element by op, which must be associative. Chunks
+// are combined in order, so op need not be commutative. With deterministic
+// set the chunks do not depend on timing or pool size, so floating point
+// sums come out the same on every run.
+template <typename Vec, typename T, typename Op>
+T parallel_reduce(ThreadPool &pool, Vec &vec, T init, Op op,
+                  bool deterministic = false, int grain = 0) {
+  int n = vec.size();
+  if (n == 0) return init;
+  if (grain <= 0) {
+    grain = deterministic ? fixedGrainSize(n) : grainSize(pool, n);
+  }
+  ElementOf<Vec> *data = &vec[0];
+  vector<Partial<T>> partials((n - 1) / grain + 1, Partial<T>{init});
+  auto body = [data, &partials, &op](int index, int begin, int end) {
+    T sum = data[begin];
+    for (int i = begin + 1; i < end; i++) {
+      sum = op(sum, data[i]);
+    }
+    partials[index].value = sum;
+  };
+  int chunks = parallelChunks(pool, n, grain, deterministic, body);
+  for (int i = 0; i < chunks; i++) {
+    init = op(init, partials[i].value);
+  }
+  return init;
+}
+
+// Replace every element with op applied over it and all before it. Each
+// fixed block is totalled, the totals are scanned in order, and each block
+// is then scanned again starting from the total before it.
+template <typename Vec, typename Op>
+void parallel_scan(ThreadPool &pool, Vec &vec, Op op, int grain = 0) {
+  typedef ElementOf<Vec> T;
+  int n = vec.size();
+  if (n == 0) return;
+  if (grain <= 0) grain = fixedGrainSize(n);
+  T *data = &vec[0];
+  vector<Partial<T>> totals((n - 1) / grain + 1, Partial<T>{data[0]});
+  auto total = [data, &totals, &op](int index, int begin, int end) {
+    T sum = data[begin];
+    for (int i = begin + 1; i < end; i++) {
+      sum = op(sum, data[i]);
+    }
+    totals[index].value = sum;
+  };
+  int chunks = parallelChunks(pool, n, grain, true, total);
+  for (int i = 1; i < chunks; i++) {
+    totals[i].value = op(totals[i - 1].value, totals[i].value);
+  }
+  auto scan = [data, &totals, &op](int index, int begin, int end) {
+    if (index > 0) data[begin] = op(totals[index - 1].value, data[begin]);
+    for (int i = begin + 1; i < end; i++) {
+      data[i] = op(data[i - 1], data[i]);
+    }
+  };
+  parallelChunks(pool, n, grain, true, scan);
+}
+
+// How many of the first k elements of a stable merge of a and b come from a
+template <typename T, typename Compare>
+int mergeSplit(int k, const T *a, int na, const T *b, int nb, Compare &comp) {
+  int low = max(0, k - nb), high = min(k, na);
+  while (low < high) {
+    int i = (low + high) / 2, j = k - i;
+    if (i < na && j > 0 && !comp(b[j - 1], a[i])) {
+      low = i + 1;
+    } else {
+      high = i;
+    }
+  }
+  return low;
+}
+
+template <typename T>
+void destroyRange(T *first, T *last) {
+  for (; first != last; first++) first->~T();
+}
+
+// Stable merge that moves from [a, aEnd) and [b, bEnd). With construct set,
+// out is raw storage and the elements are built there; if comp or a move
+// throws, the ones already built are destroyed again.
+template <typename T, typename Compare>
+void moveMerge(T *a, T *aEnd, T *b, T *bEnd, T *out, bool construct,
+               Compare &comp) {
+  T *start = out;
+  try {
+    for (; a != aEnd || b != bEnd; out++) {
+      T &next = b != bEnd && (a == aEnd || comp(*b, *a)) ? *b++ : *a++;
+      if (construct) {
+        new (out) T(std::move(next));
+      } else {
+        *out = std::move(next);
+      }
+    }
+  } catch (...) {
+    if (construct) destroyRange(start, out);
+    throw;
+  }
+}
+
+// Stable merge sort. Blocks are sorted in parallel, then merged pairwise
+// until one run is left. Every merge pass is split by output position, with
+// the inputs of each chunk found by binary search, so even the final merge
+// of two halves keeps all threads busy.
+template <typename Vec, typename Compare>
+void parallel_sort(ThreadPool &pool, Vec &vec, Compare comp) {
+  typedef ElementOf<Vec> T;
+  int n = vec.size();
+  if (n < 2) return;
+  int grain = grainSize(pool, n);
+  T *data = &vec[0];
+  auto sortBlock = [data, &comp](int, int begin, int end) {
+    stable_sort(data + begin, data + end, comp);
+  };
+  parallelChunks(pool, n, grain, true, sortBlock);
+  if (grain >= n) return;
+
+  // The scratch buffer starts out raw: the first pass move-constructs into
+  // it and later passes assign. Until the first pass is through, built
+  // holds the range each chunk has built, so a throw can undo exactly that.
+  int chunks = (n - 1) / grain + 1;
+  allocator<T> alloc;
+  T *buffer = alloc.allocate(n);
+  vector<pair<int, int>> built(chunks, make_pair(0, 0));
+  vector<int> split(chunks + 1);
+  bool raw = true;
+  T *src = data, *dst = buffer;
+  try {
+    // Runs double in width each pass; the test avoids overflowing int
+    for (int width = grain; width < n; width = width > n / 2 ? n : width * 2) {
+      // Chunks move their inputs out, so where each chunk starts in the
+      // runs it merges is found before any of them runs
+      for (int c = 0; c <= chunks; c++) {
+        int pos = min(c * grain, n), left = pos - pos % (2 * width);
+        int mid = min(left + width, n), right = min(left + 2 * width, n);
+        split[c] = mergeSplit(pos - left, src + left, mid - left, src + mid,
+                              right - mid, comp);
+      }
+      auto mergeRuns = [&src, &dst, &built, &split, raw, n, width,
+                           &comp](int index, int begin, int end) {
+        // A chunk may span the output of several pairs of runs
+        int first = begin - begin % (2 * width);
+        int done = begin;
+        try {
+          for (int left = first; left < end; left += 2 * width) {
+            int mid = min(left + width, n), right = min(left + 2 * width, n);
+            int from = max(begin, left) - left, to = min(end, right) - left;
+            int i0 = begin > left ? split[index] : 0;
+            int i1 = end < right ? split[index + 1] : mid - left;
+            moveMerge(src + left + i0, src + left + i1,
+                      src + mid + from - i0, src + mid + to - i1,
+                      dst + left + from, raw, comp);
+            done = left + to;
+          }
+        } catch (...) {
+          if (raw) destroyRange(dst + begin, dst + done);
+          throw;
+        }
+        if (raw) built[index] = make_pair(begin, end);
+      };
+      parallelChunks(pool, n, grain, true, mergeRuns);
+      raw = false;
+      swap(src, dst);
+    }
+
+    if (src != data) {
+      auto copyBack = [src, data](int, int begin, int end) {
+        std::move(src + begin, src + end, data + begin);
+      };
+      parallelChunks(pool, n, grain, false, copyBack);
+    }
+  } catch (...) {
+    if (raw) {
+      for (pair<int, int> &range : built) {
+        destroyRange(buffer + range.first, buffer + range.second);
+      }
+    } else {
+      destroyRange(buffer, buffer + n);
+    }
+    alloc.deallocate(buffer, n);
+    throw;
+  }
+  destroyRange(buffer, buffer + n);
+  alloc.deallocate(buffer, n);
+}
+
+template <typename Vec>
+void parallel_sort(ThreadPool &pool, Vec &vec) {
+  parallel_sort(pool, vec, less<ElementOf<Vec>>());
+}
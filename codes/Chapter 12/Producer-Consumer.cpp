@@ -1,35 +1,209 @@
 #include <stdio.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 using namespace std;
 
+// A log call as raw data: the format string, a function that knows the
+// argument types, and the arguments themselves. Formatting happens later on
+// the logger's thread.
+struct LogRecord {
+  const char *format;
+  int (*print)(char *buf, size_t size, const LogRecord &record);
+  alignas(8) char args[32];
+};
+
+// Lock-free ring of records with exactly one producer thread and one consumer
+// thread
+class LogRing {
+ public:
+  LogRing() : _head(0), _tail(0), _closed(false) {}
+
+  bool push(const LogRecord &record) {
+    size_t tail = _tail.load(memory_order_relaxed);
+    if (tail - _head.load(memory_order_acquire) == CAPACITY) return false;
+    _records[tail % CAPACITY] = record;
+    _tail.store(tail + 1, memory_order_release);
+    return true;
+  }
+
+  bool pop(LogRecord &record) {
+    size_t head = _head.load(memory_order_relaxed);
+    if (head == _tail.load(memory_order_acquire)) return false;
+    record = _records[head % CAPACITY];
+    _head.store(head + 1, memory_order_release);
+    return true;
+  }
+
+  void close() { _closed.store(true, memory_order_release); }
+  bool closed() const { return _closed.load(memory_order_acquire); }
+
+ private:
+  static const size_t CAPACITY = 1024;
+
+  LogRecord _records[CAPACITY];
+  // Padding keeps the two indices on separate cache lines
+  char _pad1[64];
+  atomic<size_t> _head;
+  char _pad2[64 - sizeof(atomic<size_t>)];
+  atomic<size_t> _tail;
+  atomic<bool> _closed;
+};
+
+// printf-style logging that only copies the call into a ring owned by the
+// calling thread. A background thread formats the records and writes them to
+// stdout in large batches. Lines from one thread keep their order; lines from
+// different threads may interleave differently than they were logged.
+class AsyncLogger {
+ public:
+  static AsyncLogger &instance() {
+    static AsyncLogger logger;
+    return logger;
+  }
+
+  // Arguments must be trivially copyable values such as ints, doubles and
+  // pointers to string literals
+  template <typename... Args>
+  void log(const char *format, Args... args) {
+    typedef tuple<Args...> Pack;
+    static_assert(sizeof(Pack) <= sizeof(LogRecord::args), "too many args");
+    static_assert(is_trivially_destructible<Pack>::value, "bad arg type");
+    LogRecord record;
+    record.format = format;
+    record.print = &print<Args...>;
+    new (record.args) Pack(args...);
+    LogRing &ring = localRing();
+    while (!ring.push(record)) {
+      this_thread::yield();
+    }
+  }
+
+  ~AsyncLogger() {
+    _stop = true;
+    _writer.join();
+  }
+
+ private:
+  static const size_t BUFFER_SIZE = 64 * 1024;
+  static const size_t MAX_LINE = 512;
+
+  vector<unique_ptr<LogRing>> _rings;
+  mutex _mutex;  // Guards _rings
+  atomic<bool> _stop;
+  thread _writer;
+
+  AsyncLogger() : _stop(false), _writer(&AsyncLogger::runInThread, this) {}
+
+  // Closes the ring when its thread exits so the writer can drop it
+  struct RingHolder {
+    LogRing *ring;
+    ~RingHolder() {
+      if (ring != nullptr) ring->close();
+    }
+  };
+
+  LogRing &localRing() {
+    thread_local RingHolder holder = {nullptr};
+    if (holder.ring == nullptr) {
+      lock_guard<mutex> lock(_mutex);
+      _rings.emplace_back(new LogRing());
+      holder.ring = _rings.back().get();
+    }
+    return *holder.ring;
+  }
+
+  template <typename... Args, size_t... I>
+  static int printPack(char *buf, size_t size, const char *format,
+                       const tuple<Args...> &args, index_sequence<I...>) {
+    return snprintf(buf, size, format, get<I>(args)...);
+  }
+
+  template <typename... Args>
+  static int print(char *buf, size_t size, const LogRecord &record) {
+    const tuple<Args...> &args = *(const tuple<Args...> *)record.args;
+    return printPack(buf, size, record.format, args,
+                     index_sequence_for<Args...>());
+  }
+
+  static void writeAll(const char *buf, size_t size) {
+    while (size > 0) {
+      ssize_t n = ::write(STDOUT_FILENO, buf, size);
+      if (n <= 0) return;
+      buf += n;
+      size -= n;
+    }
+  }
+
+  void runInThread() {
+    vector<char> buf(BUFFER_SIZE);
+    size_t len = 0;
+    while (true) {
+      bool stopping = _stop;  // Read before the last sweep
+      bool idle = true;
+      {
+        lock_guard<mutex> lock(_mutex);
+        for (auto it = _rings.begin(); it != _rings.end();) {
+          bool closed = (*it)->closed();
+          LogRecord record;
+          while ((*it)->pop(record)) {
+            if (BUFFER_SIZE - len < MAX_LINE) {
+              writeAll(buf.data(), len);
+              len = 0;
+            }
+            int n = record.print(&buf[len], MAX_LINE, record);
+            if (n > 0) len += n < (int)MAX_LINE ? n : MAX_LINE - 1;
+            idle = false;
+          }
+          it = closed ? _rings.erase(it) : it + 1;
+        }
+      }
+      writeAll(buf.data(), len);
+      len = 0;
+      if (stopping) return;
+      if (idle) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+  }
+};
+
 mutex _mutex;
 condition_variable cv;
 
 class Queue {
  public:
   void put(int val) {
-    unique_lock<mutex> lock(_mutex);
-    while (!q.empty()) {
-      cv.wait(lock);
+    {
+      unique_lock<mutex> lock(_mutex);
+      while (!q.empty()) {
+        cv.wait(lock);
+      }
+      q.push(val);
+      cv.notify_all();
     }
-    q.push(val);
-    cv.notify_all();
-    printf("Producer produces %d\n", val);
+    AsyncLogger::instance().log("Producer produces %d\n", val);
   }
 
   int get() {
-    unique_lock<mutex> lock(_mutex);
-    while (q.empty()) {
-      cv.wait(lock);
+    int val;
+    {
+      unique_lock<mutex> lock(_mutex);
+      while (q.empty()) {
+        cv.wait(lock);
+      }
+      val = q.front();
+      q.pop();
+      cv.notify_all();
     }
-    int val = q.front();
-    q.pop();
-    cv.notify_all();
-    printf("Consumer consumes %d\n", val);
+    AsyncLogger::instance().log("Consumer consumes %d\n", val);
     return val;
   }
 
@@ -1,4 +1,7 @@
+#include <cstddef>
 #include <iostream>
+#include <type_traits>
+#include <utility>
 using namespace std;
 
 class VGA {
@@ -8,7 +11,7 @@ class VGA {
 
 class TV1 : public VGA {
  public:
-  void play() { cout << "TV1: VGA" << endl; }
+  void play() { cout << "TV1: VGA\n"; }
 };
 
 class HDMI {
@@ -18,7 +21,7 @@ class HDMI {
 
 class TV2 : public HDMI {
  public:
-  void play() { cout << "TV2: HDMI" << endl; }
+  void play() { cout << "TV2: HDMI\n"; }
 };
 
 class Adapter : public VGA {
@@ -30,7 +33,52 @@ class Adapter : public VGA {
   HDMI *pHDMI;
 };
 
+// Embeds the adaptee by value and calls it non-virtually, so the forwarding
+// costs nothing once inlined. Being final, calls through a StaticAdapter<T>
+// itself are devirtualized as well.
+template <typename T>
+class StaticAdapter final : public VGA {
+ public:
+  // Builds the adaptee in place; copying a StaticAdapter still copies it
+  template <typename... Args,
+            typename = typename enable_if<
+                is_constructible<T, Args &&...>::value>::type>
+  StaticAdapter(Args &&...args) : _hdmi(std::forward<Args>(args)...) {}
+  void play() { _hdmi.T::play(); }
+  T &adaptee() { return _hdmi; }
+
+ private:
+  T _hdmi;
+};
+
+// Adapts a whole array of HDMI devices of one concrete type: one virtual call
+// plays them all, each with a direct call
+template <typename T>
+class ArrayAdapter final : public VGA {
+ public:
+  ArrayAdapter(T *devices, size_t n) : _devices(devices), _n(n) {}
+  void play() {
+    for (size_t i = 0; i < _n; i++) {
+      _devices[i].T::play();
+    }
+  }
+
+ private:
+  T *_devices;
+  size_t _n;
+};
+
 class Computer {
  public:
   void playVideo(VGA *pVGA) { pVGA->play(); }
+
+  // A final VGA device, such as StaticAdapter, cannot be anything but its
+  // static type, so the call is made without the vtable. Other devices go
+  // through the pointer overload and keep their overrides.
+  template <typename Device>
+  typename enable_if<is_base_of<VGA, Device>::value &&
+                     is_final<Device>::value>::type
+  playVideo(Device &device) {
+    device.Device::play();
+  }
 };
\ No newline at end of file
@@ -3,22 +3,23 @@ using namespace std;
 
 class Car {
  public:
+  virtual ~Car() {}
   virtual void show() = 0;
 };
 
 class Bmw : public Car {
  public:
-  void show() { cout << "This is a BMW" << endl; }
+  void show() { cout << "This is a BMW\n"; }
 };
 
 class Audi : public Car {
  public:
-  void show() { cout << "This is an Audi" << endl; }
+  void show() { cout << "This is an Audi\n"; }
 };
 
 class Benz : public Car {
  public:
-  void show() { cout << "This is a Benz" << endl; }
+  void show() { cout << "This is a Benz\n"; }
 };
 
 class CarDecorator1 : public Car {
@@ -27,7 +28,7 @@ class CarDecorator1 : public Car {
   ~CarDecorator1() { delete pCar; }
   void show() {
     pCar->show();
-    cout << "Feature 1" << endl;
+    cout << "Feature 1\n";
   }
 
  private:
@@ -40,7 +41,7 @@ class CarDecorator2 : public Car {
   ~CarDecorator2() { delete pCar; }
   void show() {
     pCar->show();
-    cout << "Feature 2" << endl;
+    cout << "Feature 2\n";
   }
 
  private:
@@ -53,9 +54,70 @@ class CarDecorator3 : public Car {
   ~CarDecorator3() { delete pCar; }
   void show() {
     pCar->show();
-    cout << "Feature 3" << endl;
+    cout << "Feature 3\n";
   }
 
  private:
   Car *pCar;
-};
\ No newline at end of file
+};
+
+struct Feature1 {
+  static void decorate() { cout << "Feature 1\n"; }
+};
+
+struct Feature2 {
+  static void decorate() { cout << "Feature 2\n"; }
+};
+
+struct Feature3 {
+  static void decorate() { cout << "Feature 3\n"; }
+};
+
+// Features chosen at compile time: the car and all of its features are one
+// object, so a decorated car is a single allocation and show() makes one
+// virtual call followed by direct, inlinable calls in order
+template <typename CarType, typename... Features>
+class DecoratedCar : public CarType {
+ public:
+  void show() {
+    CarType::show();
+    int expand[] = {0, (Features::decorate(), 0)...};
+    (void)expand;
+  }
+};
+
+// Features chosen at runtime: the car is built inside the decorator, so a
+// decorated car is still a single allocation, and the stages are kept in a
+// flat array and run in one loop instead of through a chain of wrappers.
+// Each stage is given the car it decorates.
+template <typename CarType>
+class FeatureChain : public CarType {
+ public:
+  using Stage = void (*)(CarType &car);
+  static const int MAX_STAGES = 16;
+
+  FeatureChain() : _count(0) {}
+
+  FeatureChain &add(Stage stage) {
+    if (_count == MAX_STAGES) throw "too many features!";
+    _stages[_count++] = stage;
+    return *this;
+  }
+
+  // Adds one of the compile-time features above as a stage
+  template <typename Feature>
+  FeatureChain &add() {
+    return add([](CarType &) { Feature::decorate(); });
+  }
+
+  void show() {
+    CarType::show();
+    for (int i = 0; i < _count; i++) {
+      _stages[i](*this);
+    }
+  }
+
+ private:
+  Stage _stages[MAX_STAGES];
+  int _count;
+};
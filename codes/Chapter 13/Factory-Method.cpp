@@ -1,10 +1,14 @@
+#include <cstddef>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 using namespace std;
 
 class Car {
  public:
   Car(string name) : _name(name) {}
+  virtual ~Car() {}
   virtual void show() = 0;
 
  protected:
@@ -14,26 +18,191 @@ class Car {
 class Bmw : public Car {
  public:
   Bmw(string name) : Car(name) {}
-  void show() { cout << "BMW: " << _name << endl; }
+  void show() { cout << "BMW: " << _name << '\n'; }
 };
 
 class Audi : public Car {
  public:
   Audi(string name) : Car(name) {}
-  void show() { cout << "Audi: " << _name << endl; }
+  void show() { cout << "Audi: " << _name << '\n'; }
 };
 
+// Hands out fixed-size slots from a free list threaded through large chunks
+class ObjectPool {
+ public:
+  ObjectPool(size_t size, size_t chunk = 1024)
+      : _size(align(size)), _chunk(chunk > 0 ? chunk : 1), _free(nullptr) {}
+
+  ~ObjectPool() {
+    for (char *chunk : _chunks) {
+      ::operator delete(chunk);
+    }
+  }
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  void *allocate() {
+    if (_free == nullptr) grow();
+    Slot *p = _free;
+    _free = _free->_next;
+    return p;
+  }
+
+  void deallocate(void *ptr) {
+    Slot *p = (Slot *)ptr;
+    p->_next = _free;
+    _free = p;
+  }
+
+ private:
+  struct Slot {
+    Slot *_next;
+  };
+
+  size_t _size;
+  size_t _chunk;
+  Slot *_free;
+  vector<char *> _chunks;
+
+  static size_t align(size_t size) {
+    size_t a = alignof(max_align_t);
+    size = size < sizeof(Slot) ? sizeof(Slot) : size;
+    return (size + a - 1) / a * a;
+  }
+
+  void grow() {
+    char *chunk = (char *)::operator new(_size * _chunk);
+    _chunks.push_back(chunk);
+    for (size_t i = _chunk; i > 0; i--) {
+      deallocate(chunk + (i - 1) * _size);
+    }
+  }
+};
+
+// Bump allocation out of a caller-supplied buffer; nothing is freed until the
+// caller releases the buffer itself
+class Arena {
+ public:
+  Arena(void *buffer, size_t size)
+      : _begin((char *)buffer), _cur((char *)buffer), _end(_begin + size) {}
+
+  void *allocate(size_t size, size_t alignment) {
+    size_t offset = (_cur - _begin + alignment - 1) / alignment * alignment;
+    if (offset + size > (size_t)(_end - _begin)) throw "arena is full!";
+    _cur = _begin + offset + size;
+    return _begin + offset;
+  }
+
+  void reset() { _cur = _begin; }
+
+ private:
+  char *_begin;
+  char *_cur;
+  char *_end;
+};
+
+// Destroys a product and gives its memory back to the pool it came from.
+// Products placed in an arena have no pool and are only destroyed.
+template <typename T>
+struct PoolDeleter {
+  PoolDeleter(ObjectPool *pool = nullptr) : _pool(pool) {}
+  void operator()(T *ptr) const {
+    void *p = dynamic_cast<void *>(ptr);
+    ptr->~T();
+    if (_pool != nullptr) _pool->deallocate(p);
+  }
+  ObjectPool *_pool;
+};
+
+// n products of one concrete type, constructed back to back in one block
+template <typename Base>
+class Batch {
+ public:
+  Batch() : _data(nullptr), _size(0), _stride(0), _offset(0) {}
+
+  template <typename T, typename... Args>
+  static Batch make(size_t n, const Args &...args) {
+    Batch batch;
+    batch._data = (char *)::operator new(sizeof(T) * n);
+    batch._stride = sizeof(T);
+    for (; batch._size < n; batch._size++) {
+      T *p = new (batch._data + batch._size * sizeof(T)) T(args...);
+      batch._offset = (char *)static_cast<Base *>(p) - (char *)p;
+    }
+    return batch;
+  }
+
+  Batch(Batch &&other)
+      : _data(other._data),
+        _size(other._size),
+        _stride(other._stride),
+        _offset(other._offset) {
+    other._data = nullptr;
+    other._size = 0;
+  }
+
+  ~Batch() {
+    for (size_t i = 0; i < _size; i++) {
+      (*this)[i].~Base();
+    }
+    ::operator delete(_data);
+  }
+
+  Base &operator[](size_t i) {
+    return *(Base *)(_data + i * _stride + _offset);
+  }
+
+  size_t size() const { return _size; }
+
+ private:
+  char *_data;
+  size_t _size;
+  size_t _stride;
+  ptrdiff_t _offset;  // From a product's address to its Base subobject
+};
+
+using CarPtr = unique_ptr<Car, PoolDeleter<Car>>;
+
+// Products come from a pool owned by the factory, so they must not outlive it
 class Factory {
  public:
-  virtual Car* createCar(string name) = 0;
+  virtual ~Factory() {}
+  virtual CarPtr createCar(string name) = 0;
+  virtual CarPtr createCar(string name, Arena &arena) = 0;
+  virtual Batch<Car> createMany(string name, size_t n) = 0;
 };
 
 class BMWFactory : public Factory {
  public:
-  Car* createCar(string name) { return new Bmw(name); }
+  BMWFactory() : _pool(sizeof(Bmw)) {}
+  CarPtr createCar(string name) {
+    return CarPtr(new (_pool.allocate()) Bmw(name), &_pool);
+  }
+  CarPtr createCar(string name, Arena &arena) {
+    return CarPtr(new (arena.allocate(sizeof(Bmw), alignof(Bmw))) Bmw(name));
+  }
+  Batch<Car> createMany(string name, size_t n) {
+    return Batch<Car>::make<Bmw>(n, name);
+  }
+
+ private:
+  ObjectPool _pool;
 };
 
 class AudiFactory : public Factory {
  public:
-  Car* createCar(string name) { return new Audi(name); }
+  AudiFactory() : _pool(sizeof(Audi)) {}
+  CarPtr createCar(string name) {
+    return CarPtr(new (_pool.allocate()) Audi(name), &_pool);
+  }
+  CarPtr createCar(string name, Arena &arena) {
+    return CarPtr(new (arena.allocate(sizeof(Audi), alignof(Audi))) Audi(name));
+  }
+  Batch<Car> createMany(string name, size_t n) {
+    return Batch<Car>::make<Audi>(n, name);
+  }
+
+ private:
+  ObjectPool _pool;
 };
\ No newline at end of file
@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <cstdint>
 #include <iostream>
-#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 using namespace std;
 
 class Observer {
@@ -13,13 +25,13 @@ class Observer1 : public Observer {
   void handle(int id) {
     switch (id) {
       case 1:
-        cout << "Observer1: Message 1" << endl;
+        cout << "Observer1: Message 1\n";
         break;
       case 2:
-        cout << "Observer1: Message 2" << endl;
+        cout << "Observer1: Message 2\n";
         break;
       default:
-        cout << "Observer1: Unknown message" << endl;
+        cout << "Observer1: Unknown message\n";
         break;
     }
   }
@@ -30,13 +42,13 @@ class Observer2 : public Observer {
   void handle(int id) {
     switch (id) {
       case 2:
-        cout << "Observer2: Message 2" << endl;
+        cout << "Observer2: Message 2\n";
         break;
       case 3:
-        cout << "Observer2: Message 3" << endl;
+        cout << "Observer2: Message 3\n";
         break;
       default:
-        cout << "Observer2: Unknown message" << endl;
+        cout << "Observer2: Unknown message\n";
         break;
     }
   }
@@ -47,30 +59,766 @@ class Observer3 : public Observer {
   void handle(int id) {
     switch (id) {
       case 1:
-        cout << "Observer3: Message 1" << endl;
+        cout << "Observer3: Message 1\n";
         break;
       case 3:
-        cout << "Observer3: Message 3" << endl;
+        cout << "Observer3: Message 3\n";
         break;
       default:
-        cout << "Observer3: Unknown message" << endl;
+        cout << "Observer3: Unknown message\n";
         break;
     }
   }
 };
 
+// A non-owning reference to a handler: an object pointer plus a plain function
+// pointer, so the subscriber table stays flat and trivially copyable
+class Callback {
+ public:
+  Callback(Observer *observer) : _obj(observer), _func(&invokeVirtual) {}
+
+  // Bind a concrete observer type; the call inside the thunk is non-virtual,
+  // so it runs T::handle even if the object overrides it
+  template <typename T>
+  static Callback bind(T *observer) {
+    return Callback(observer, &invokeDirect<T>);
+  }
+
+  // Bind any callable taking an int; the callable must outlive the callback
+  template <typename F>
+  static Callback ref(F &func) {
+    return Callback(&func, &invokeCallable<F>);
+  }
+
+  void operator()(int id) const { _func(_obj, id); }
+
+ private:
+  void *_obj;
+  void (*_func)(void *, int);
+
+  Callback(void *obj, void (*func)(void *, int)) : _obj(obj), _func(func) {}
+
+  static void invokeVirtual(void *obj, int id) {
+    static_cast<Observer *>(obj)->handle(id);
+  }
+
+  template <typename T>
+  static void invokeDirect(void *obj, int id) {
+    static_cast<T *>(obj)->T::handle(id);
+  }
+
+  template <typename F>
+  static void invokeCallable(void *obj, int id) {
+    (*static_cast<F *>(obj))(id);
+  }
+};
+
+// Subscribers per message id: small non-negative ids index a dense table
+// directly, larger ones fall back to hashing
+template <typename T>
+class RouteTable {
+ public:
+  vector<T> &slot(int id) {
+    if (id >= 0 && id < DENSE_IDS) {
+      if (id >= (int)_dense.size()) _dense.resize(id + 1);
+      return _dense[id];
+    }
+    return _sparse[id];
+  }
+
+  const vector<T> *find(int id) const {
+    if (id >= 0 && id < DENSE_IDS) {
+      return id < (int)_dense.size() ? &_dense[id] : nullptr;
+    }
+    auto it = _sparse.find(id);
+    return it != _sparse.end() ? &it->second : nullptr;
+  }
+
+ private:
+  static const int DENSE_IDS = 1024;
+
+  vector<vector<T>> _dense;
+  unordered_map<int, vector<T>> _sparse;
+};
+
 class Subject {
  public:
-  void subscribe(Observer *observer, int id) { _map[id].push_back(observer); }
+  // Dispatch through the vtable
+  void subscribe(Observer *observer, int id) {
+    _routes.slot(id).push_back(Callback(observer));
+  }
+
+  // Dispatch straight to T::handle, skipping the vtable. Only for observers
+  // whose dynamic type is exactly T.
+  template <typename T>
+  void subscribeDirect(T *observer, int id) {
+    _routes.slot(id).push_back(Callback::bind(observer));
+  }
+
+  void subscribe(Callback callback, int id) {
+    _routes.slot(id).push_back(callback);
+  }
+
+  void publish(int id) const {
+    const vector<Callback> *subscribers = _routes.find(id);
+    if (subscribers != nullptr) {
+      for (const Callback &callback : *subscribers) {
+        callback(id);
+      }
+    }
+  }
+
+ private:
+  RouteTable<Callback> _routes;
+};
+
+// What a publisher does when a subscriber's queue is full
+enum Backpressure {
+  BLOCK,        // Wait until the subscriber catches up
+  DROP_OLDEST,  // Discard the oldest queued message
+  COALESCE      // Skip ids already queued; drop the oldest if still full
+};
+
+struct MailboxStats {
+  size_t depth;
+  size_t maxDepth;
+  size_t handled;
+  size_t dropped;
+  chrono::nanoseconds totalLatency;
+  chrono::nanoseconds maxLatency;
+};
+
+// A bounded queue of pending messages for one subscriber
+class Mailbox {
+ public:
+  Mailbox(Callback callback, size_t capacity, Backpressure policy)
+      : _callback(callback),
+        _capacity(capacity > 0 ? capacity : 1),
+        _policy(policy),
+        _scheduled(false),
+        _stats() {}
+
+  // Returns true if the mailbox needs to be handed to a worker
+  bool push(int id) {
+    unique_lock<mutex> lock(_mutex);
+    if (_policy == COALESCE && _pending.count(id) > 0) {
+      _stats.dropped++;
+      return false;
+    }
+    if (_queue.size() >= _capacity) {
+      if (_policy == BLOCK) {
+        _notFull.wait(lock, [this] { return _queue.size() < _capacity; });
+      } else {
+        if (_policy == COALESCE) _pending.erase(_queue.front());
+        _queue.pop_front();
+        _stats.dropped++;
+      }
+    }
+    _queue.push_back(id);
+    if (_policy == COALESCE) _pending.insert(id);
+    if (_queue.size() > _stats.maxDepth) _stats.maxDepth = _queue.size();
+    if (_scheduled) return false;
+    _scheduled = true;
+    return true;
+  }
+
+  // Handle up to batch messages; returns true if more are left and the
+  // mailbox should be rescheduled
+  bool drain(size_t batch) {
+    vector<int> ids;
+    {
+      lock_guard<mutex> lock(_mutex);
+      while (!_queue.empty() && ids.size() < batch) {
+        ids.push_back(_queue.front());
+        _queue.pop_front();
+        if (_policy == COALESCE) _pending.erase(ids.back());
+      }
+    }
+    _notFull.notify_all();
+
+    chrono::nanoseconds total(0), worst(0);
+    for (int id : ids) {
+      auto start = chrono::steady_clock::now();
+      _callback(id);
+      auto elapsed = chrono::steady_clock::now() - start;
+      total += elapsed;
+      if (elapsed > worst) worst = elapsed;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    _stats.handled += ids.size();
+    _stats.totalLatency += total;
+    if (worst > _stats.maxLatency) _stats.maxLatency = worst;
+    if (_queue.empty()) _scheduled = false;
+    return _scheduled;
+  }
+
+  MailboxStats stats() const {
+    lock_guard<mutex> lock(_mutex);
+    MailboxStats stats = _stats;
+    stats.depth = _queue.size();
+    return stats;
+  }
+
+ private:
+  Callback _callback;
+  size_t _capacity;
+  Backpressure _policy;
+  deque<int> _queue;
+  unordered_set<int> _pending;  // Ids in the queue, for COALESCE
+  bool _scheduled;              // Queued for or owned by a worker
+  MailboxStats _stats;
+  mutable mutex _mutex;
+  condition_variable _notFull;
+};
+
+// Publishing only enqueues; handlers run on a pool of worker threads in
+// batches, and each subscriber sees its messages in order on one thread at a
+// time. Subscribe everything before the first publish.
+class AsyncSubject {
+ public:
+  AsyncSubject(int threads = 4, size_t batch = 64)
+      : _batch(batch > 0 ? batch : 1), _stop(false) {
+    for (int i = 0; i < threads; i++) {
+      _workers.push_back(thread(&AsyncSubject::runInThread, this));
+    }
+  }
+
+  // Handles everything already published before returning
+  ~AsyncSubject() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    for (thread &t : _workers) {
+      t.join();
+    }
+  }
+
+  // Returns a subscriber index for stats()
+  int subscribe(Callback callback, int id, size_t capacity = 1024,
+                Backpressure policy = BLOCK) {
+    _mailboxes.emplace_back(new Mailbox(callback, capacity, policy));
+    _routes.slot(id).push_back(_mailboxes.back().get());
+    return _mailboxes.size() - 1;
+  }
+
+  // See Subject::subscribeDirect()
+  template <typename T>
+  int subscribeDirect(T *observer, int id, size_t capacity = 1024,
+                      Backpressure policy = BLOCK) {
+    return subscribe(Callback::bind(observer), id, capacity, policy);
+  }
+
   void publish(int id) {
-    auto it = _map.find(id);
-    if (it != _map.end()) {
-      for (Observer *p : it->second) {
-        p->handle(id);
+    const vector<Mailbox *> *mailboxes = _routes.find(id);
+    if (mailboxes == nullptr) return;
+    for (Mailbox *mailbox : *mailboxes) {
+      if (mailbox->push(id)) schedule(mailbox);
+    }
+  }
+
+  MailboxStats stats(int subscriber) const {
+    return _mailboxes[subscriber]->stats();
+  }
+
+ private:
+  RouteTable<Mailbox *> _routes;
+  vector<unique_ptr<Mailbox>> _mailboxes;
+  vector<thread> _workers;
+  deque<Mailbox *> _ready;
+  size_t _batch;
+  bool _stop;
+  mutex _mutex;
+  condition_variable _cv;
+
+  void schedule(Mailbox *mailbox) {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _ready.push_back(mailbox);
+    }
+    _cv.notify_one();
+  }
+
+  void runInThread() {
+    while (true) {
+      Mailbox *mailbox;
+      {
+        unique_lock<mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _stop || !_ready.empty(); });
+        if (_ready.empty()) return;
+        mailbox = _ready.front();
+        _ready.pop_front();
+      }
+      if (mailbox->drain(_batch)) schedule(mailbox);
+    }
+  }
+};
+
+// Each thread gets a small index on first use, recycled when the thread exits
+class ThreadIndex {
+ public:
+  static const int MAX_THREADS = 128;
+
+  static int get() {
+    thread_local ThreadIndex index;
+    return index._id;
+  }
+
+ private:
+  int _id;
+
+  ThreadIndex() {
+    lock_guard<mutex> lock(guard());
+    vector<bool> &used = inUse();
+    _id = find(used.begin(), used.end(), false) - used.begin();
+    if (_id == MAX_THREADS) throw "too many threads!";
+    used[_id] = true;
+  }
+
+  ~ThreadIndex() {
+    lock_guard<mutex> lock(guard());
+    inUse()[_id] = false;
+  }
+
+  static mutex &guard() {
+    static mutex m;
+    return m;
+  }
+
+  static vector<bool> &inUse() {
+    static vector<bool> used(MAX_THREADS, false);
+    return used;
+  }
+};
+
+// Epoch-based reclamation: readers announce the epoch they entered in, and an
+// object retired in epoch e may be freed once no reader is still in e or
+// earlier
+class EpochDomain {
+ public:
+  EpochDomain() : _epoch(1) {
+    for (Slot &slot : _slots) {
+      slot.epoch = 0;
+      slot.depth = 0;
+    }
+  }
+
+  void enter() {
+    Slot &slot = _slots[ThreadIndex::get()];
+    if (slot.depth++ == 0) slot.epoch.store(_epoch.load());
+  }
+
+  void leave() {
+    Slot &slot = _slots[ThreadIndex::get()];
+    if (--slot.depth == 0) slot.epoch.store(0, memory_order_release);
+  }
+
+  // Call after unlinking an object; returns the epoch it was retired in
+  uint64_t retire() { return _epoch.fetch_add(1); }
+
+  // Whether the calling thread is between enter() and leave()
+  bool reading() const { return _slots[ThreadIndex::get()].depth > 0; }
+
+  bool canFree(uint64_t retired) const {
+    for (const Slot &slot : _slots) {
+      uint64_t epoch = slot.epoch.load();
+      if (epoch != 0 && epoch <= retired) return false;
+    }
+    return true;
+  }
+
+  // Wait until no thread can see anything retired in the given epoch. Must
+  // not be called inside a reader: two threads doing so would wait for each
+  // other forever.
+  void synchronize(uint64_t retired) const {
+    for (int i = 0; i < ThreadIndex::MAX_THREADS; i++) {
+      while (true) {
+        uint64_t epoch = _slots[i].epoch.load();
+        if (epoch == 0 || epoch > retired) break;
+        this_thread::yield();
       }
     }
   }
 
  private:
-  unordered_map<int, list<Observer *>> _map;
+  struct alignas(64) Slot {
+    atomic<uint64_t> epoch;  // 0 when the thread is not reading
+    int depth;               // Only touched by the owning thread
+  };
+
+  atomic<uint64_t> _epoch;
+  Slot _slots[ThreadIndex::MAX_THREADS];
+};
+
+class ConcurrentSubject;
+
+// Unsubscribes when destroyed; must not outlive its subject
+class Subscription {
+ public:
+  Subscription() : _subject(nullptr), _token(0) {}
+  ~Subscription() { reset(); }
+
+  Subscription(Subscription &&other)
+      : _subject(other._subject), _token(other._token) {
+    other._subject = nullptr;
+  }
+
+  Subscription &operator=(Subscription &&other) {
+    if (this == &other) return *this;
+    reset();
+    _subject = other._subject;
+    _token = other._token;
+    other._subject = nullptr;
+    return *this;
+  }
+
+  Subscription(const Subscription &) = delete;
+  Subscription &operator=(const Subscription &) = delete;
+
+  // Once this returns, no publish on another thread can reach the handler.
+  // Called from inside a handler it cannot wait for other publishers, so it
+  // only stops new calls; one already running elsewhere may still finish.
+  void reset();
+
+ private:
+  ConcurrentSubject *_subject;
+  uint64_t _token;
+
+  friend class ConcurrentSubject;
+  Subscription(ConcurrentSubject *subject, uint64_t token)
+      : _subject(subject), _token(token) {}
+};
+
+// Subscriptions may change while any number of threads publish. Publishers
+// read an immutable snapshot of the subscriber table without taking a lock;
+// writers copy it, swap in the new one and free old ones through epochs.
+// At most ThreadIndex::MAX_THREADS live threads may publish; publish() throws
+// on any thread beyond that.
+class ConcurrentSubject {
+ public:
+  ConcurrentSubject() : _snapshot(new Snapshot()), _nextToken(1) {}
+
+  ~ConcurrentSubject() {
+    delete _snapshot.load();
+    for (auto &id : _ids) {
+      delete id.second.alive;
+    }
+    for (Retired &retired : _retired) {
+      delete retired.snapshot;
+      delete retired.alive;
+    }
+  }
+
+  Subscription subscribe(Callback callback, int id) {
+    lock_guard<mutex> lock(_mutex);
+    uint64_t token = _nextToken++;
+    atomic<bool> *alive = new atomic<bool>(true);
+    Snapshot *next = new Snapshot(*_snapshot.load());
+    next->slot(id).push_back(Entry{callback, token, alive});
+    _ids[token] = Registration{id, alive};
+    replace(next, nullptr);
+    return Subscription(this, token);
+  }
+
+  // See Subject::subscribeDirect()
+  template <typename T>
+  Subscription subscribeDirect(T *observer, int id) {
+    return subscribe(Callback::bind(observer), id);
+  }
+
+  void publish(int id) const {
+    EpochGuard guard(_domain);
+    const vector<Entry> *subscribers = _snapshot.load()->find(id);
+    if (subscribers != nullptr) {
+      for (const Entry &entry : *subscribers) {
+        if (entry.alive->load(memory_order_acquire)) entry.callback(id);
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    Callback callback;
+    uint64_t token;
+    atomic<bool> *alive;  // Cleared on unsubscribe, for older snapshots
+  };
+
+  struct Registration {
+    int id;
+    atomic<bool> *alive;
+  };
+
+  // Freed once no reader can still see it
+  using Snapshot = RouteTable<Entry>;
+  struct Retired {
+    uint64_t epoch;
+    Snapshot *snapshot;
+    atomic<bool> *alive;
+  };
+
+  struct EpochGuard {
+    EpochGuard(EpochDomain &domain) : _domain(domain) { _domain.enter(); }
+    ~EpochGuard() { _domain.leave(); }
+    EpochDomain &_domain;
+  };
+
+  atomic<Snapshot *> _snapshot;
+  mutable EpochDomain _domain;
+  mutex _mutex;  // Serializes writers
+  uint64_t _nextToken;
+  unordered_map<uint64_t, Registration> _ids;
+  vector<Retired> _retired;
+
+  friend class Subscription;
+
+  void unsubscribe(uint64_t token) {
+    uint64_t retired;
+    {
+      lock_guard<mutex> lock(_mutex);
+      auto it = _ids.find(token);
+      if (it == _ids.end()) return;
+      Snapshot *next = new Snapshot(*_snapshot.load());
+      vector<Entry> &entries = next->slot(it->second.id);
+      entries.erase(remove_if(entries.begin(), entries.end(),
+                              [token](const Entry &entry) {
+                                return entry.token == token;
+                              }),
+                    entries.end());
+      atomic<bool> *alive = it->second.alive;
+      alive->store(false, memory_order_release);
+      _ids.erase(it);
+      retired = replace(next, alive);
+    }
+    // Inside a handler, waiting could deadlock with another thread doing the
+    // same, so rely on the cleared flag alone
+    if (!_domain.reading()) _domain.synchronize(retired);
+  }
+
+  // Publish a new snapshot and free what no reader can still see
+  uint64_t replace(Snapshot *next, atomic<bool> *alive) {
+    Snapshot *prev = _snapshot.exchange(next);
+    uint64_t epoch = _domain.retire();
+    _retired.push_back(Retired{epoch, prev, alive});
+    auto it = _retired.begin();
+    while (it != _retired.end()) {
+      if (_domain.canFree(it->epoch)) {
+        delete it->snapshot;
+        delete it->alive;
+        it = _retired.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return epoch;
+  }
+};
+
+void Subscription::reset() {
+  if (_subject != nullptr) _subject->unsubscribe(_token);
+  _subject = nullptr;
+}
+
+// Routes dot-separated topics such as "orders.eu.filled". In a pattern, "*"
+// matches exactly one segment and "#" matches any number of segments, so
+// "orders.*.filled" and "orders.#" both match the topic above. Patterns live
+// in a trie, so matching costs depend on the topic's length rather than the
+// number of subscriptions, and the result for each topic is cached until the
+// subscriptions change.
+class TopicSubject {
+ public:
+  using Handler = function<void(const string &)>;
+
+  TopicSubject() : _root(new Node()), _nextToken(1), _depth(0), _stale(false) {}
+
+  // Returns a token for unsubscribe(). A subscription made by a handler gets
+  // no messages from the publish that is running.
+  int subscribe(const string &pattern, Handler handler) {
+    Node *node = _root.get();
+    size_t pos = 0;
+    while (pos <= pattern.size()) {
+      size_t dot = pattern.find('.', pos);
+      if (dot == string::npos) dot = pattern.size();
+      unique_ptr<Node> &child = node->child(pattern.substr(pos, dot - pos));
+      if (!child) child.reset(new Node());
+      node = child.get();
+      pos = dot + 1;
+    }
+    int token = _nextToken++;
+    node->tokens.push_back(token);
+    _handlers[token] = Subscriber{handler, pattern, node, true};
+    invalidate();
+    return token;
+  }
+
+  // Safe inside a handler, including for the handler's own subscription
+  void unsubscribe(int token) {
+    auto it = _handlers.find(token);
+    if (it == _handlers.end() || !it->second.active) return;
+    Subscriber &subscriber = it->second;
+    vector<int> &tokens = subscriber.node->tokens;
+    tokens.erase(std::find(tokens.begin(), tokens.end(), token));
+    prune(subscriber.pattern);
+    subscriber.active = false;
+    // A running publish may still hold a pointer to the subscriber
+    if (_depth > 0) {
+      _removed.push_back(token);
+    } else {
+      _handlers.erase(it);
+    }
+    invalidate();
+  }
+
+  void publish(const string &topic) {
+    // Cached routes are only dropped by the outermost publish, since an outer
+    // one may be walking them
+    if (_depth == 0 && _stale) {
+      _cache.clear();
+      _stale = false;
+    }
+    const vector<const Subscriber *> *subscribers;
+    vector<const Subscriber *> uncached;
+    auto it = _cache.find(topic);
+    if (_stale || (it == _cache.end() && _depth > 0 &&
+                   _cache.size() >= MAX_CACHED)) {
+      // A stale hit may miss subscriptions made by a running handler
+      uncached = route(topic);
+      subscribers = &uncached;
+    } else if (it != _cache.end()) {
+      subscribers = &it->second;
+    } else {
+      if (_cache.size() >= MAX_CACHED) _cache.clear();
+      subscribers = &_cache.emplace(topic, route(topic)).first->second;
+    }
+
+    Publishing publishing(*this);
+    for (const Subscriber *subscriber : *subscribers) {
+      if (subscriber->active) subscriber->handler(topic);
+    }
+  }
+
+ private:
+  struct Node {
+    unordered_map<string, unique_ptr<Node>> children;
+    unique_ptr<Node> star;  // "*"
+    unique_ptr<Node> hash;  // "#"
+    vector<int> tokens;     // Subscriptions whose pattern ends here
+
+    unique_ptr<Node> &child(const string &segment) {
+      if (segment == "*") return star;
+      if (segment == "#") return hash;
+      return children[segment];
+    }
+
+    bool empty() const {
+      return children.empty() && !star && !hash && tokens.empty();
+    }
+  };
+
+  struct Subscriber {
+    Handler handler;
+    string pattern;
+    Node *node;
+    bool active;  // Cleared by unsubscribe while a publish is running
+  };
+
+  // Counts a running publish, even one left by a throwing handler
+  class Publishing {
+   public:
+    Publishing(TopicSubject &subject) : _subject(subject) {
+      _subject._depth++;
+    }
+    ~Publishing() {
+      if (--_subject._depth > 0) return;
+      for (int token : _subject._removed) {
+        _subject._handlers.erase(token);
+      }
+      _subject._removed.clear();
+    }
+
+   private:
+    TopicSubject &_subject;
+  };
+
+  static const size_t MAX_CACHED = 4096;
+
+  unique_ptr<Node> _root;
+  int _nextToken;
+  // Values are never moved by rehashing, so cached pointers stay valid
+  unordered_map<int, Subscriber> _handlers;
+  unordered_map<string, vector<const Subscriber *>> _cache;
+  int _depth;            // Nested publish calls currently running
+  bool _stale;           // The cache is out of date but may be in use
+  vector<int> _removed;  // Unsubscribed while publishing
+
+  void invalidate() {
+    if (_depth > 0) {
+      _stale = true;
+    } else {
+      _cache.clear();
+    }
+  }
+
+  // Free the nodes on the pattern's path that no longer lead anywhere
+  void prune(const string &pattern) {
+    vector<pair<Node *, string>> path;
+    Node *node = _root.get();
+    size_t pos = 0;
+    while (pos <= pattern.size()) {
+      size_t dot = pattern.find('.', pos);
+      if (dot == string::npos) dot = pattern.size();
+      path.push_back(make_pair(node, pattern.substr(pos, dot - pos)));
+      node = node->child(path.back().second).get();
+      pos = dot + 1;
+    }
+    for (auto step = path.rbegin(); step != path.rend(); ++step) {
+      Node *parent = step->first;
+      const string &segment = step->second;
+      if (!parent->child(segment)->empty()) break;
+      if (segment == "*" || segment == "#") {
+        parent->child(segment).reset();
+      } else {
+        parent->children.erase(segment);
+      }
+    }
+  }
+
+  vector<const Subscriber *> route(const string &topic) const {
+    vector<int> tokens;
+    match(_root.get(), topic, 0, tokens);
+    sort(tokens.begin(), tokens.end());
+    tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+    vector<const Subscriber *> subscribers;
+    for (int token : tokens) {
+      subscribers.push_back(&_handlers.at(token));
+    }
+    return subscribers;
+  }
+
+  // Collect the subscriptions under node matching the topic from pos onwards;
+  // pos is past the end once every segment has been consumed
+  void match(const Node *node, const string &topic, size_t pos,
+             vector<int> &tokens) const {
+    if (node->hash) {
+      // "#" swallows zero or more of the remaining segments
+      for (size_t p = pos; p <= topic.size();) {
+        match(node->hash.get(), topic, p, tokens);
+        size_t dot = topic.find('.', p);
+        p = dot == string::npos ? topic.size() + 1 : dot + 1;
+      }
+      match(node->hash.get(), topic, topic.size() + 1, tokens);
+    }
+    if (pos > topic.size()) {
+      tokens.insert(tokens.end(), node->tokens.begin(), node->tokens.end());
+      return;
+    }
+    size_t dot = topic.find('.', pos);
+    if (dot == string::npos) dot = topic.size();
+    auto it = node->children.find(topic.substr(pos, dot - pos));
+    if (it != node->children.end()) {
+      match(it->second.get(), topic, dot + 1, tokens);
+    }
+    if (node->star) match(node->star.get(), topic, dot + 1, tokens);
+  }
 };
\ No newline at end of file
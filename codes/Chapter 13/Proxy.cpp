@@ -1,36 +1,150 @@
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 using namespace std;
 
 class Movie {
  public:
+  virtual ~Movie() {}
   virtual void freeMovie() = 0;
   virtual void vipMovie() = 0;
+  virtual string details(const string &title) = 0;
 };
 
 class MovieSite : public Movie {
  public:
-  virtual void freeMovie() { cout << "Free Movie" << endl; }
-  virtual void vipMovie() { cout << "VIP Movie" << endl; }
+  virtual void freeMovie() { cout << "Free Movie\n"; }
+  virtual void vipMovie() { cout << "VIP Movie\n"; }
+  // Stands in for an expensive backend request
+  virtual string details(const string &title) { return "Details of " + title; }
+};
+
+// Creates the real subject on first use, exactly once even when several
+// threads get there together
+template <typename T>
+class LazySubject {
+ public:
+  LazySubject() {}
+  T *get() {
+    call_once(_once, [this] { _subject.reset(new T()); });
+    return _subject.get();
+  }
+  T *operator->() { return get(); }
+
+ private:
+  once_flag _once;
+  unique_ptr<T> _subject;
+};
+
+// Memoizes a backend call by key. Entries expire after ttl and the least
+// recently used one is evicted beyond capacity. Concurrent misses for the same
+// key wait for a single backend call instead of issuing their own.
+template <typename Key, typename Value>
+class CachingProxy {
+ public:
+  using Clock = chrono::steady_clock;
+
+  CachingProxy(function<Value(const Key &)> backend, size_t capacity,
+               Clock::duration ttl)
+      : _backend(backend), _capacity(capacity > 0 ? capacity : 1), _ttl(ttl) {}
+
+  Value get(const Key &key) {
+    unique_lock<mutex> lock(_mutex);
+    auto it = _cache.find(key);
+    if (it != _cache.end()) {
+      if (Clock::now() < it->second.expires) {
+        _lru.splice(_lru.begin(), _lru, it->second.pos);
+        return it->second.value;
+      }
+      _lru.erase(it->second.pos);
+      _cache.erase(it);
+    }
+
+    auto pending = _inFlight.find(key);
+    if (pending != _inFlight.end()) {
+      shared_future<Value> result = pending->second;
+      lock.unlock();
+      return result.get();
+    }
+
+    promise<Value> result;
+    _inFlight[key] = result.get_future().share();
+    lock.unlock();
+
+    Value value;
+    try {
+      value = _backend(key);
+    } catch (...) {
+      lock.lock();
+      _inFlight.erase(key);
+      lock.unlock();
+      result.set_exception(current_exception());
+      throw;
+    }
+
+    lock.lock();
+    _inFlight.erase(key);
+    _lru.push_front(key);
+    _cache[key] = Entry{value, Clock::now() + _ttl, _lru.begin()};
+    if (_cache.size() > _capacity) {
+      _cache.erase(_lru.back());
+      _lru.pop_back();
+    }
+    lock.unlock();
+    result.set_value(value);
+    return value;
+  }
+
+ private:
+  struct Entry {
+    Value value;
+    Clock::time_point expires;
+    typename list<Key>::iterator pos;  // In _lru
+  };
+
+  function<Value(const Key &)> _backend;
+  size_t _capacity;
+  Clock::duration _ttl;
+  unordered_map<Key, Entry> _cache;
+  list<Key> _lru;  // Most recently used first
+  unordered_map<Key, shared_future<Value>> _inFlight;
+  mutex _mutex;
 };
 
 class FreeMovieProxy : public Movie {
  public:
-  FreeMovieProxy() { pMovie = new MovieSite(); }
-  ~FreeMovieProxy() { delete pMovie; }
+  FreeMovieProxy()
+      : _details([this](const string &title) {
+                   return pMovie->details(title);
+                 },
+                 1024, chrono::minutes(5)) {}
   virtual void freeMovie() { pMovie->freeMovie(); }
-  virtual void vipMovie() { cout << "Permission denied!" << endl; }
+  virtual void vipMovie() { cout << "Permission denied!\n"; }
+  virtual string details(const string &title) { return _details.get(title); }
 
  private:
-  MovieSite *pMovie;
+  LazySubject<MovieSite> pMovie;
+  CachingProxy<string, string> _details;
 };
 
 class VipMovieProxy : public Movie {
  public:
-  VipMovieProxy() { pMovie = new MovieSite(); }
-  ~VipMovieProxy() { delete pMovie; }
+  VipMovieProxy()
+      : _details([this](const string &title) {
+                   return pMovie->details(title);
+                 },
+                 1024, chrono::minutes(5)) {}
   virtual void freeMovie() { pMovie->freeMovie(); }
   virtual void vipMovie() { pMovie->vipMovie(); }
+  virtual string details(const string &title) { return _details.get(title); }
 
  private:
-  MovieSite *pMovie;
-};
\ No newline at end of file
+  LazySubject<MovieSite> pMovie;
+  CachingProxy<string, string> _details;
+};
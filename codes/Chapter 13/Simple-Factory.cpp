@@ -1,10 +1,16 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 using namespace std;
 
 class Car {
  public:
   Car(string name) : _name(name) {}
+  virtual ~Car() {}
   virtual void show() = 0;
 
  protected:
@@ -14,26 +20,320 @@ class Car {
 class Bmw : public Car {
  public:
   Bmw(string name) : Car(name) {}
-  void show() { cout << "BMW: " << _name << endl; }
+  void show() { cout << "BMW: " << _name << '\n'; }
 };
 
 class Audi : public Car {
  public:
   Audi(string name) : Car(name) {}
-  void show() { cout << "Audi: " << _name << endl; }
+  void show() { cout << "Audi: " << _name << '\n'; }
 };
 
-enum CarType { BMW, AUDI };
+// The first address at or after p that is a multiple of alignment
+inline char *alignUp(char *p, size_t alignment) {
+  uintptr_t n = (uintptr_t)p;
+  return p + ((n + alignment - 1) / alignment * alignment - n);
+}
 
+// Hands out fixed-size slots from a free list threaded through large chunks.
+// Slots are aligned to at least max_align_t, or more if asked.
+class ObjectPool {
+ public:
+  ObjectPool(size_t size, size_t alignment = alignof(max_align_t),
+             size_t chunk = 1024)
+      : _align(alignment > alignof(max_align_t) ? alignment
+                                                : alignof(max_align_t)),
+        _size(align(size)),
+        _chunk(chunk > 0 ? chunk : 1),
+        _free(nullptr) {}
+
+  ~ObjectPool() {
+    for (char *chunk : _chunks) {
+      ::operator delete(chunk);
+    }
+  }
+
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  void *allocate() {
+    if (_free == nullptr) grow();
+    Slot *p = _free;
+    _free = _free->_next;
+    return p;
+  }
+
+  void deallocate(void *ptr) {
+    Slot *p = (Slot *)ptr;
+    p->_next = _free;
+    _free = p;
+  }
+
+ private:
+  struct Slot {
+    Slot *_next;
+  };
+
+  size_t _align;
+  size_t _size;
+  size_t _chunk;
+  Slot *_free;
+  vector<char *> _chunks;
+
+  size_t align(size_t size) const {
+    size = size < sizeof(Slot) ? sizeof(Slot) : size;
+    return (size + _align - 1) / _align * _align;
+  }
+
+  // operator new only guarantees max_align_t, so room is left to align up
+  void grow() {
+    char *chunk = (char *)::operator new(_size * _chunk + _align - 1);
+    _chunks.push_back(chunk);
+    char *first = alignUp(chunk, _align);
+    for (size_t i = _chunk; i > 0; i--) {
+      deallocate(first + (i - 1) * _size);
+    }
+  }
+};
+
+// Bump allocation out of a caller-supplied buffer; nothing is freed until the
+// caller releases the buffer itself
+class Arena {
+ public:
+  Arena(void *buffer, size_t size)
+      : _begin((char *)buffer), _cur((char *)buffer), _end(_begin + size) {}
+
+  void *allocate(size_t size, size_t alignment) {
+    size_t offset = (_cur - _begin + alignment - 1) / alignment * alignment;
+    if (offset + size > (size_t)(_end - _begin)) throw "arena is full!";
+    _cur = _begin + offset + size;
+    return _begin + offset;
+  }
+
+  void reset() { _cur = _begin; }
+
+ private:
+  char *_begin;
+  char *_cur;
+  char *_end;
+};
+
+// Destroys a product and gives its memory back to the pool it came from.
+// Products placed in an arena have no pool and are only destroyed.
+template <typename T>
+struct PoolDeleter {
+  PoolDeleter(ObjectPool *pool = nullptr) : _pool(pool) {}
+  void operator()(T *ptr) const {
+    void *p = dynamic_cast<void *>(ptr);
+    ptr->~T();
+    if (_pool != nullptr) _pool->deallocate(p);
+  }
+  ObjectPool *_pool;
+};
+
+// n products of one concrete type, constructed back to back in one block
+template <typename Base>
+class Batch {
+ public:
+  Batch()
+      : _block(nullptr), _data(nullptr), _size(0), _stride(0), _offset(0) {}
+
+  template <typename T, typename... Args>
+  static Batch make(size_t n, const Args &...args) {
+    Batch batch;
+    // Over-allocated so that an over-aligned T can be aligned up
+    batch._block = (char *)::operator new(sizeof(T) * n + alignof(T) - 1);
+    batch._data = alignUp(batch._block, alignof(T));
+    batch._stride = sizeof(T);
+    for (; batch._size < n; batch._size++) {
+      T *p = new (batch._data + batch._size * sizeof(T)) T(args...);
+      batch._offset = (char *)static_cast<Base *>(p) - (char *)p;
+    }
+    return batch;
+  }
+
+  Batch(Batch &&other)
+      : _block(other._block),
+        _data(other._data),
+        _size(other._size),
+        _stride(other._stride),
+        _offset(other._offset) {
+    other._block = other._data = nullptr;
+    other._size = 0;
+  }
+
+  ~Batch() {
+    for (size_t i = 0; i < _size; i++) {
+      (*this)[i].~Base();
+    }
+    ::operator delete(_block);
+  }
+
+  Base &operator[](size_t i) {
+    return *(Base *)(_data + i * _stride + _offset);
+  }
+
+  size_t size() const { return _size; }
+
+ private:
+  char *_block;  // As allocated; _data is aligned for the products
+  char *_data;
+  size_t _size;
+  size_t _stride;
+  ptrdiff_t _offset;  // From a product's address to its Base subobject
+};
+
+using CarPtr = unique_ptr<Car, PoolDeleter<Car>>;
+
+enum CarType { BMW, AUDI, CAR_TYPES };
+
+// Every product type registers how to build itself. Enum keys index the table
+// directly; string keys go through a perfect hash rebuilt on each registration,
+// so a lookup is one hash, one probe and one string compare.
+class CarRegistry {
+ public:
+  struct Entry {
+    const char *key;
+    const char *model;
+    size_t size;
+    size_t align;
+    Car *(*construct)(void *p, const string &model);
+    Batch<Car> (*makeBatch)(size_t n, const string &model);
+  };
+
+  // Pass type < 0 for products that are only known by their string key. A
+  // key registered again replaces the earlier product; a type registered
+  // again replaces the product at that index. Returns the product's index.
+  template <typename T>
+  static int add(int type, const char *key, const char *model) {
+    CarRegistry &registry = instance();
+    vector<Entry> &entries = registry._entries;
+    Entry entry = {key, model, sizeof(T), alignof(T), &construct<T>,
+                   &makeBatch<T>};
+    int existing = indexOf(key);
+    int index = type >= 0 ? type : existing;
+    if (index < 0) index = entries.size();
+    if (index >= (int)entries.size()) entries.resize(index + 1, Entry());
+    // One key per entry, or no seed could give a perfect table
+    if (existing >= 0 && existing != index) entries[existing].key = nullptr;
+    entries[index] = entry;
+    registry.rebuild();
+    return index;
+  }
+
+  static const Entry *find(int index) {
+    const vector<Entry> &entries = instance()._entries;
+    if (index < 0 || index >= (int)entries.size()) return nullptr;
+    return entries[index].construct != nullptr ? &entries[index] : nullptr;
+  }
+
+  static int indexOf(const string &key) {
+    const CarRegistry &registry = instance();
+    uint32_t h = hash(key.c_str(), registry._seed);
+    int index = registry._table[h & (registry._table.size() - 1)];
+    if (index < 0 || key != registry._entries[index].key) return -1;
+    return index;
+  }
+
+ private:
+  vector<Entry> _entries;
+  vector<int> _table;  // Perfect hash slot -> entry index, -1 if empty
+  uint32_t _seed;
+
+  CarRegistry() : _entries(CAR_TYPES, Entry()), _table(1, -1), _seed(0) {}
+
+  static CarRegistry &instance() {
+    static CarRegistry registry;
+    return registry;
+  }
+
+  template <typename T>
+  static Car *construct(void *p, const string &model) {
+    return new (p) T(model);
+  }
+
+  template <typename T>
+  static Batch<Car> makeBatch(size_t n, const string &model) {
+    return Batch<Car>::make<T>(n, model);
+  }
+
+  // FNV-1a with a seed mixed into the offset basis
+  static uint32_t hash(const char *s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (; *s != '\0'; s++) {
+      h = (h ^ (unsigned char)*s) * 16777619u;
+    }
+    return h;
+  }
+
+  // Search for a seed that maps every key to its own slot
+  void rebuild() {
+    size_t size = 1;
+    while (size < _entries.size() * 2) size *= 2;
+    for (uint32_t seed = 0;; seed++) {
+      if (seed > 0 && seed % 64 == 0) size *= 2;
+      vector<int> table(size, -1);
+      bool perfect = true;
+      for (int i = 0; i < (int)_entries.size() && perfect; i++) {
+        if (_entries[i].key == nullptr) continue;
+        int &slot = table[hash(_entries[i].key, seed) & (size - 1)];
+        perfect = slot < 0;
+        slot = i;
+      }
+      if (perfect) {
+        _table.swap(table);
+        _seed = seed;
+        return;
+      }
+    }
+  }
+};
+
+template <typename T>
+struct CarRegistrar {
+  CarRegistrar(int type, const char *key, const char *model) {
+    index = CarRegistry::add<T>(type, key, model);
+  }
+  int index;
+};
+
+static CarRegistrar<Bmw> bmwRegistrar(BMW, "bmw", "X1");
+static CarRegistrar<Audi> audiRegistrar(AUDI, "audi", "A6");
+
+// Products come from a per-type pool owned by the factory, so they must not
+// outlive it. Unknown keys give nullptr or an empty batch.
 class SimpleFactory {
  public:
-  Car* createCar(CarType ct) {
-    switch (ct) {
-      case BMW:
-        return new Bmw("X1");
-      case AUDI:
-        return new Audi("A6");
+  CarPtr createCar(CarType ct) { return create(ct); }
+
+  CarPtr createCar(const string &key) {
+    return create(CarRegistry::indexOf(key));
+  }
+
+  CarPtr createCar(CarType ct, Arena &arena) {
+    const CarRegistry::Entry *entry = CarRegistry::find(ct);
+    if (entry == nullptr) return nullptr;
+    void *p = arena.allocate(entry->size, entry->align);
+    return CarPtr(entry->construct(p, entry->model));
+  }
+
+  Batch<Car> createMany(CarType ct, size_t n) {
+    const CarRegistry::Entry *entry = CarRegistry::find(ct);
+    if (entry == nullptr) return Batch<Car>();
+    return entry->makeBatch(n, entry->model);
+  }
+
+ private:
+  vector<unique_ptr<ObjectPool>> _pools;  // By registry index
+
+  CarPtr create(int index) {
+    const CarRegistry::Entry *entry = CarRegistry::find(index);
+    if (entry == nullptr) return nullptr;
+    if (index >= (int)_pools.size()) _pools.resize(index + 1);
+    if (!_pools[index]) {
+      _pools[index].reset(new ObjectPool(entry->size, entry->align));
     }
-    return nullptr;
+    ObjectPool *pool = _pools[index].get();
+    return CarPtr(entry->construct(pool->allocate(), entry->model), pool);
   }
 };
\ No newline at end of file
@@ -1,4 +1,10 @@
+#include <atomic>
+#include <functional>
 #include <mutex>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
 using namespace std;
 
 class Singleton1 {
@@ -17,20 +23,25 @@ mutex _mutex;
 class Singleton2 {
  public:
   static Singleton2* getInstance() {
-    if (instance == nullptr) {
+    Singleton2* p = instance.load(memory_order_acquire);
+    if (p == nullptr) {
       lock_guard<mutex> lock(_mutex);
-      if (instance == nullptr) instance = new Singleton2();
+      p = instance.load(memory_order_relaxed);
+      if (p == nullptr) {
+        p = new Singleton2();
+        instance.store(p, memory_order_release);
+      }
     }
-    return instance;
+    return p;
   }
 
  private:
-  static Singleton2* volatile instance;
+  static atomic<Singleton2*> instance;
   Singleton2() {}
   Singleton2(const Singleton2&) = delete;
   Singleton2& operator=(const Singleton2&) = delete;
 };
-Singleton2* volatile Singleton2::instance = nullptr;
+atomic<Singleton2*> Singleton2::instance(nullptr);
 
 class Singleton3 {
  public:
@@ -43,4 +54,104 @@ class Singleton3 {
   Singleton3() {}
   Singleton3(const Singleton3&) = delete;
   Singleton3& operator=(const Singleton3&) = delete;
+};
+
+// Double-checked locking for any T, with creation and teardown at points the
+// program chooses. T may keep its constructor private and befriend
+// Singleton<T>.
+template <typename T>
+class Singleton {
+ public:
+  // Create the instance now rather than on first use
+  template <typename... Args>
+  static T* init(Args&&... args) {
+    lock_guard<mutex> lock(_mutex);
+    T* p = _instance.load(memory_order_relaxed);
+    if (p == nullptr) {
+      p = new T(std::forward<Args>(args)...);
+      _instance.store(p, memory_order_release);
+    }
+    return p;
+  }
+
+  static T* getInstance() {
+    T* p = _instance.load(memory_order_acquire);
+    return p != nullptr ? p : init();
+  }
+
+  // Cached per thread, so later calls only compare a generation number that
+  // changes on destroy(), after which the cache is refreshed
+  static T* getCached() {
+    thread_local T* cached = nullptr;
+    thread_local unsigned generation = 0;
+    unsigned current = _generation.load(memory_order_acquire);
+    if (cached == nullptr || generation != current) {
+      // Read before the instance, so a destroy() in between is noticed next
+      // time
+      generation = current;
+      cached = getInstance();
+    }
+    return cached;
+  }
+
+  // Destroy the instance once nothing uses it any more
+  static void destroy() {
+    lock_guard<mutex> lock(_mutex);
+    delete _instance.exchange(nullptr, memory_order_acq_rel);
+    _generation.fetch_add(1, memory_order_release);
+  }
+
+ private:
+  static atomic<T*> _instance;
+  static atomic<unsigned> _generation;
+  static mutex _mutex;
+};
+
+template <typename T>
+atomic<T*> Singleton<T>::_instance(nullptr);
+
+template <typename T>
+atomic<unsigned> Singleton<T>::_generation(0);
+
+template <typename T>
+mutex Singleton<T>::_mutex;
+
+// For mutable service objects: one instance per shard, each on its own cache
+// line. A thread picks the shard of the CPU it first runs on and keeps it, so
+// threads on different CPUs rarely touch the same line. Threads sharing a
+// shard still access it concurrently, so T must be thread-safe itself.
+template <typename T, int SHARDS = 64>
+class ShardedSingleton {
+ public:
+  static T& local() {
+    thread_local T* mine = nullptr;
+    if (mine == nullptr) mine = &shards()[pickShard()].value;
+    return *mine;
+  }
+
+  // Visit every shard, e.g. to sum per-shard counters
+  template <typename F>
+  static void forEach(F func) {
+    for (int i = 0; i < SHARDS; i++) {
+      func(shards()[i].value);
+    }
+  }
+
+ private:
+  struct alignas(64) Shard {
+    T value;
+  };
+
+  static Shard* shards() {
+    static Shard instances[SHARDS];
+    return instances;
+  }
+
+  static int pickShard() {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0) return cpu % SHARDS;
+#endif
+    return hash<thread::id>()(this_thread::get_id()) % SHARDS;
+  }
 };
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// The virtual hierarchy from the factory examples, with a price to total up
+
+class Car {
+ public:
+  Car(string name, double price) : _name(name), _price(price) {}
+  virtual ~Car() {}
+  virtual void show() = 0;
+  virtual double price() const = 0;
+
+ protected:
+  string _name;
+  double _price;
+};
+
+class Bmw : public Car {
+ public:
+  Bmw(string name, double price) : Car(name, price) {}
+  void show() { cout << "BMW: " << _name << '\n'; }
+  double price() const { return _price * 1.2; }
+};
+
+class Audi : public Car {
+ public:
+  Audi(string name, double price) : Car(name, price) {}
+  void show() { cout << "Audi: " << _name << '\n'; }
+  double price() const { return _price * 1.1; }
+};
+
+// The same products as a closed set with static polymorphism: the base class
+// knows the concrete type at compile time, so calls through it are direct and
+// can be inlined
+
+template <typename Derived>
+class StaticCar {
+ public:
+  StaticCar(string name, double price) : _name(name), _price(price) {}
+  void show() { static_cast<Derived *>(this)->showImpl(); }
+  double price() const {
+    return static_cast<const Derived *>(this)->priceImpl();
+  }
+
+ protected:
+  string _name;
+  double _price;
+};
+
+class StaticBmw : public StaticCar<StaticBmw> {
+ public:
+  StaticBmw(string name, double price) : StaticCar(name, price) {}
+  void showImpl() { cout << "BMW: " << _name << '\n'; }
+  double priceImpl() const { return _price * 1.2; }
+};
+
+class StaticAudi : public StaticCar<StaticAudi> {
+ public:
+  StaticAudi(string name, double price) : StaticCar(name, price) {}
+  void showImpl() { cout << "Audi: " << _name << '\n'; }
+  double priceImpl() const { return _price * 1.1; }
+};
+
+template <typename Derived>
+class StaticLight {
+ public:
+  void show() { static_cast<Derived *>(this)->showImpl(); }
+};
+
+class StaticBmwLight : public StaticLight<StaticBmwLight> {
+ public:
+  void showImpl() { cout << "BMW Light\n"; }
+};
+
+class StaticAudiLight : public StaticLight<StaticAudiLight> {
+ public:
+  void showImpl() { cout << "Audi Light\n"; }
+};
+
+// Products of a closed set of types, each type stored contiguously in its own
+// vector. forEach() visits every product with its concrete type, so the
+// visitor is instantiated once per type and no call is indirect.
+template <typename... Ts>
+class ProductSet {
+ public:
+  template <typename T, typename... Args>
+  T &emplace(Args &&...args) {
+    vector<T> &list = get<vector<T>>(_lists);
+    list.emplace_back(std::forward<Args>(args)...);
+    return list.back();
+  }
+
+  template <typename T>
+  vector<T> &all() {
+    return get<vector<T>>(_lists);
+  }
+
+  template <typename F>
+  void forEach(F &&func) {
+    int expand[] = {0, (visit(get<vector<Ts>>(_lists), func), 0)...};
+    (void)expand;
+  }
+
+  size_t size() const {
+    size_t sizes[] = {0, get<vector<Ts>>(_lists).size()...};
+    size_t total = 0;
+    for (size_t n : sizes) total += n;
+    return total;
+  }
+
+ private:
+  tuple<vector<Ts>...> _lists;
+
+  template <typename T, typename F>
+  static void visit(vector<T> &list, F &func) {
+    for (T &product : list) {
+      func(product);
+    }
+  }
+};
+
+using CarSet = ProductSet<StaticBmw, StaticAudi>;
+using LightSet = ProductSet<StaticBmwLight, StaticAudiLight>;
+
+// Total the price of n cars both ways and report the time taken
+int main() {
+  const int n = 1000000;
+  const int rounds = 20;
+
+  vector<unique_ptr<Car>> virtualCars;
+  CarSet staticCars;
+  for (int i = 0; i < n; i++) {
+    if (i % 2 == 0) {
+      virtualCars.emplace_back(new Bmw("X1", i));
+      staticCars.emplace<StaticBmw>("X1", i);
+    } else {
+      virtualCars.emplace_back(new Audi("A6", i));
+      staticCars.emplace<StaticAudi>("A6", i);
+    }
+  }
+
+  auto start = chrono::steady_clock::now();
+  double virtualTotal = 0;
+  for (int r = 0; r < rounds; r++) {
+    for (const unique_ptr<Car> &car : virtualCars) {
+      virtualTotal += car->price();
+    }
+  }
+  auto virtualTime = chrono::steady_clock::now() - start;
+
+  start = chrono::steady_clock::now();
+  double staticTotal = 0;
+  for (int r = 0; r < rounds; r++) {
+    staticCars.forEach([&staticTotal](const auto &car) {
+      staticTotal += car.price();
+    });
+  }
+  auto staticTime = chrono::steady_clock::now() - start;
+
+  using ms = chrono::milliseconds;
+  cout << "virtual: " << chrono::duration_cast<ms>(virtualTime).count()
+       << " ms, total " << virtualTotal << '\n';
+  cout << "static:  " << chrono::duration_cast<ms>(staticTime).count()
+       << " ms, total " << staticTotal << '\n';
+
+  LightSet lights;
+  lights.emplace<StaticBmwLight>();
+  lights.emplace<StaticAudiLight>();
+  lights.forEach([](auto &light) { light.show(); });
+  return 0;
+}
@@ -1,20 +1,277 @@
-#include <iostream>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 using namespace std;
 
+// Output collected in a per-thread buffer and handed to the OS in large
+// writes: when the buffer fills up, on flush(), and when the thread exits.
+// Nothing is flushed per line, so code that also prints through cout should
+// flush() before switching.
+class OutBuffer {
+ public:
+  static OutBuffer &local() {
+    thread_local OutBuffer buffer(STDOUT_FILENO);
+    return buffer;
+  }
+
+  explicit OutBuffer(int fd) : _fd(fd), _len(0) {}
+  ~OutBuffer() { flush(); }
+
+  OutBuffer(const OutBuffer &) = delete;
+  OutBuffer &operator=(const OutBuffer &) = delete;
+
+  void flush() {
+    writeAll(_buf, _len);
+    _len = 0;
+  }
+
+  OutBuffer &append(const char *s, size_t n) {
+    if (n > SIZE - _len) {
+      flush();
+      if (n > SIZE) {
+        writeAll(s, n);
+        return *this;
+      }
+    }
+    memcpy(_buf + _len, s, n);
+    _len += n;
+    return *this;
+  }
+
+  OutBuffer &operator<<(const char *s) { return append(s, strlen(s)); }
+
+  OutBuffer &operator<<(char c) {
+    if (_len == SIZE) flush();
+    _buf[_len++] = c;
+    return *this;
+  }
+
+  // Like cout: character types print as characters, bool as 0 or 1
+  OutBuffer &operator<<(signed char c) { return *this << (char)c; }
+  OutBuffer &operator<<(unsigned char c) { return *this << (char)c; }
+  OutBuffer &operator<<(bool value) { return *this << (value ? '1' : '0'); }
+
+  template <typename T>
+  typename enable_if<is_integral<T>::value, OutBuffer &>::type operator<<(
+      T value) {
+    char tmp[24];
+    return append(tmp, toChars(tmp, value) - tmp);
+  }
+
+  // Same digits as cout's default formatting
+  OutBuffer &operator<<(double value) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%g", value);
+    return append(tmp, n);
+  }
+
+  template <typename T>
+  static char *toChars(char *buf, T value) {
+    typename make_unsigned<T>::type v = value;
+    if (value < 0) {
+      *buf++ = '-';
+      v = 0 - v;
+    }
+    char digits[24];
+    int n = 0;
+    do {
+      digits[n++] = '0' + v % 10;
+      v /= 10;
+    } while (v > 0);
+    while (n > 0) *buf++ = digits[--n];
+    return buf;
+  }
+
+ private:
+  static const size_t SIZE = 64 * 1024;
+
+  int _fd;
+  size_t _len;
+  char _buf[SIZE];
+
+  void writeAll(const char *s, size_t n) {
+    while (n > 0) {
+      ssize_t written = ::write(_fd, s, n);
+      if (written <= 0) return;
+      s += written;
+      n -= written;
+    }
+  }
+};
+
+// A date packed into 4 bytes as the number of days since 1970-01-01, so
+// comparing dates and adding days are single integer operations. Conversions
+// to and from year/month/day are constexpr (C++14).
+class Date {
+ public:
+  // Years whose day numbers fit in _days with room to spare
+  static const int MIN_YEAR = -5000000;
+  static const int MAX_YEAR = 5000000;
+
+  constexpr Date(int y, int m, int d) : _days(fromCivil(y, m, d)) {}
+
+  static constexpr Date fromDays(int32_t days) { return Date(days); }
+
+  void show() const { write(OutBuffer::local()); }
+
+  void write(OutBuffer &out) const {
+    char buf[16];
+    out.append(buf, format(buf) - buf) << '\n';
+  }
+
+  constexpr int32_t days() const { return _days; }
+  constexpr int year() const { return toCivil(_days).year; }
+  constexpr int month() const { return toCivil(_days).month; }
+  constexpr int day() const { return toCivil(_days).day; }
+
+  // yyyymm
+  constexpr int yearMonth() const {
+    return toCivil(_days).year * 100 + toCivil(_days).month;
+  }
+
+  constexpr Date operator+(int days) const { return Date(_days + days); }
+  constexpr Date operator-(int days) const { return Date(_days - days); }
+  constexpr int operator-(const Date &other) const {
+    return _days - other._days;
+  }
+  Date &operator+=(int days) {
+    _days += days;
+    return *this;
+  }
+
+  constexpr bool operator==(const Date &other) const {
+    return _days == other._days;
+  }
+  constexpr bool operator!=(const Date &other) const {
+    return _days != other._days;
+  }
+  constexpr bool operator<(const Date &other) const {
+    return _days < other._days;
+  }
+  constexpr bool operator<=(const Date &other) const {
+    return _days <= other._days;
+  }
+  constexpr bool operator>(const Date &other) const {
+    return _days > other._days;
+  }
+  constexpr bool operator>=(const Date &other) const {
+    return _days >= other._days;
+  }
+
+  // Write "y/m/d" without a terminating '\0' and return the end; buf needs
+  // room for 16 characters
+  char *format(char *buf) const {
+    Civil c = toCivil(_days);
+    buf = formatInt(buf, c.year);
+    *buf++ = '/';
+    buf = formatInt(buf, c.month);
+    *buf++ = '/';
+    return formatInt(buf, c.day);
+  }
+
+  // Read "y/m/d" or "y-m-d"; returns the end of the date, or nullptr if the
+  // text is not a valid date or the year is outside MIN_YEAR..MAX_YEAR
+  static const char *parse(const char *s, Date &date) {
+    int y, m, d;
+    if ((s = parseInt(s, y)) == nullptr || (*s != '/' && *s != '-')) {
+      return nullptr;
+    }
+    if ((s = parseInt(s + 1, m)) == nullptr || (*s != '/' && *s != '-')) {
+      return nullptr;
+    }
+    if ((s = parseInt(s + 1, d)) == nullptr) return nullptr;
+    if (y < MIN_YEAR || y > MAX_YEAR) return nullptr;
+    if (m < 1 || m > 12 || d < 1 || d > daysInMonth(y, m)) return nullptr;
+    date = Date(y, m, d);
+    return s;
+  }
+
+ private:
+  int32_t _days;
+
+  struct Civil {
+    int year;
+    int month;
+    int day;
+  };
+
+  explicit constexpr Date(int32_t days) : _days(days) {}
+
+  // Howard Hinnant's days_from_civil / civil_from_days, valid for the whole
+  // proleptic Gregorian calendar
+  static constexpr int32_t fromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+  }
+
+  static constexpr Civil toCivil(int32_t days) {
+    int z = days + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    return Civil{yoe + era * 400 + (m <= 2), m, doy - (153 * mp + 2) / 5 + 1};
+  }
+
+  static constexpr int daysInMonth(int y, int m) {
+    return m == 2 ? 28 + ((y % 4 == 0 && y % 100 != 0) || y % 400 == 0)
+                  : 30 + ((m + (m > 7)) % 2);
+  }
+
+  static char *formatInt(char *buf, int value) {
+    return OutBuffer::toChars(buf, value);
+  }
+
+  static const char *parseInt(const char *s, int &value) {
+    bool negative = *s == '-';
+    if (negative) s++;
+    if (*s < '0' || *s > '9') return nullptr;
+    value = 0;
+    for (int n = 0; *s >= '0' && *s <= '9'; s++) {
+      if (++n > 9) return nullptr;
+      value = value * 10 + (*s - '0');
+    }
+    if (negative) value = -value;
+    return s;
+  }
+};
+
 class Goods {
  public:  // Methods
   // Initialize goods information
-  Goods(const char *name, double price, int amount);
-  // Print goods information
+  Goods(const char *name, double price, int amount, int y, int m, int d);
+  // Print goods information; see OutBuffer for when it reaches the screen
   void show();
-  // Getters
+  void show() const;
+  void write(OutBuffer &out) const;
+  // Setters
   void setName(const char *name) { strcpy(_name, name); }
   void setPrice(double price) { _price = price; };
   void setAmount(int amount) { _amount = amount; };
-  // Setters
+  // Getters
   const char *getName() { return _name; };
   double getPrice() { return _price; };
   int getAmount() { return _amount; };
+  const Date &getDate() const { return _date; }
   static void showCounts();
 
  private:  // Variables
@@ -28,41 +285,412 @@ class Goods {
 int Goods::_count = 0;
 
 Goods::Goods(const char *name, double price, int amount, int y, int m, int d)
-    : _date(y, m, d), _price(price), _amount(amount) {
+    : _price(price), _amount(amount), _date(y, m, d) {
   strcpy(_name, name);
-  count++;
+  _count++;
 }
 
-void Goods::show() {
-  cout << "name: " << _name << endl;
-  cout << "price: " << _price << endl;
-  cout << "amount: " << _amount << endl;
-  _date.show();
+void Goods::show() { write(OutBuffer::local()); };
+
+void Goods::show() const { write(OutBuffer::local()); };
+
+void Goods::write(OutBuffer &out) const {
+  out << "name: " << _name << '\n';
+  out << "price: " << _price << '\n';
+  out << "amount: " << _amount << '\n';
+  _date.write(out);
+}
+
+void Goods::showCounts() { OutBuffer::local() << "Counts: " << _count << '\n'; }
+
+// Goods stored column by column: each field lives in its own contiguous array
+// and names are interned, so a scan only touches the columns it needs. The
+// aggregate loops are branch-free so the compiler can vectorize them, and each
+// can be split across threads.
+//
+// Lookups go through indexes instead: rows by name, a search tree ordered by
+// price, and rows bucketed by month. The setters keep them up to date.
+class Inventory {
+ public:
+  // Returns the row of the new item
+  size_t add(const char *name, double price, int amount, const Date &date) {
+    size_t row = _price.size();
+    int id = intern(name);
+    _name.push_back(id);
+    _price.push_back(price);
+    _amount.push_back(amount);
+    _date.push_back(date.days());
+    _rowsByName[id].push_back(row);
+    _byPrice.insert(make_pair(price, row));
+    _byMonth[date.yearMonth()].push_back(row);
+    return row;
+  }
+
+  size_t add(Goods &goods) {
+    return add(goods.getName(), goods.getPrice(), goods.getAmount(),
+               goods.getDate());
+  }
+
+  size_t size() const { return _price.size(); }
+
+  const char *getName(size_t row) const { return _names[_name[row]].c_str(); }
+  double getPrice(size_t row) const { return _price[row]; }
+  int getAmount(size_t row) const { return _amount[row]; }
+
+  void setName(size_t row, const char *name) {
+    int id = intern(name);
+    vector<size_t> &rows = _rowsByName[_name[row]];
+    rows.erase(find(rows.begin(), rows.end(), row));
+    _rowsByName[id].push_back(row);
+    _name[row] = id;
+  }
+
+  void setPrice(size_t row, double price) {
+    _byPrice.erase(make_pair(_price[row], row));
+    _byPrice.insert(make_pair(price, row));
+    _price[row] = price;
+  }
+
+  void setAmount(size_t row, int amount) { _amount[row] = amount; }
+
+  // Rows named exactly name
+  vector<size_t> findByName(const char *name) const {
+    auto it = _nameIds.find(name);
+    if (it == _nameIds.end()) return vector<size_t>();
+    return _rowsByName[it->second];
+  }
+
+  // Rows priced in [low, high), cheapest first
+  vector<size_t> findByPrice(double low, double high) const {
+    vector<size_t> rows;
+    auto it = _byPrice.lower_bound(make_pair(low, (size_t)0));
+    for (; it != _byPrice.end() && it->first < high; ++it) {
+      rows.push_back(it->second);
+    }
+    return rows;
+  }
+
+  // Rows dated in [from, to]; only the months in between are visited
+  vector<size_t> findByDate(const Date &from, const Date &to) const {
+    vector<size_t> rows;
+    int low = from.days(), high = to.days();
+    auto it = _byMonth.lower_bound(from.yearMonth());
+    for (; it != _byMonth.end() && it->first <= to.yearMonth(); ++it) {
+      for (size_t row : it->second) {
+        if (_date[row] >= low && _date[row] <= high) rows.push_back(row);
+      }
+    }
+    return rows;
+  }
+
+  // Sum of price * amount
+  double totalValue(int threads = 1) const {
+    return scan<double>(threads, [this](size_t begin, size_t end) {
+      double total = 0;
+      for (size_t i = begin; i < end; i++) {
+        total += _price[i] * _amount[i];
+      }
+      return total;
+    });
+  }
+
+  // Sum of price * amount over goods priced in [low, high)
+  double valueInPriceBand(double low, double high, int threads = 1) const {
+    return scan<double>(threads, [=](size_t begin, size_t end) {
+      double total = 0;
+      for (size_t i = begin; i < end; i++) {
+        bool in = _price[i] >= low && _price[i] < high;
+        total += in ? _price[i] * _amount[i] : 0.0;
+      }
+      return total;
+    });
+  }
+
+  // Number of goods dated in [from, to]
+  size_t countInDateRange(const Date &from, const Date &to,
+                          int threads = 1) const {
+    int low = from.days(), high = to.days();
+    return scan<size_t>(threads, [=](size_t begin, size_t end) {
+      size_t count = 0;
+      for (size_t i = begin; i < end; i++) {
+        count += _date[i] >= low && _date[i] <= high;
+      }
+      return count;
+    });
+  }
+
+  // Rows of goods priced in [low, high)
+  vector<size_t> filterByPrice(double low, double high) const {
+    vector<size_t> rows(size());
+    size_t n = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+      rows[n] = i;
+      n += _price[i] >= low && _price[i] < high;
+    }
+    rows.resize(n);
+    return rows;
+  }
+
+  // Write a binary snapshot that InventorySnapshot can map; see below
+  bool save(const char *path) const;
+
+ private:
+  vector<string> _names;  // Interned names
+  unordered_map<string, int> _nameIds;
+  vector<int> _name;  // Index into _names
+  vector<double> _price;
+  vector<int> _amount;
+  vector<int> _date;  // Date::days()
+
+  vector<vector<size_t>> _rowsByName;  // By name id
+  set<pair<double, size_t>> _byPrice;
+  map<int, vector<size_t>> _byMonth;  // By Date::yearMonth()
+
+  int intern(const char *name) {
+    auto it = _nameIds.find(name);
+    if (it == _nameIds.end()) {
+      it = _nameIds.emplace(name, (int)_names.size()).first;
+      _names.push_back(name);
+      _rowsByName.push_back(vector<size_t>());
+    }
+    return it->second;
+  }
+
+  // Run kernel(begin, end) over equal slices of the rows, one per thread,
+  // and add up the partial results
+  template <typename T, typename F>
+  T scan(int threads, F kernel) const {
+    size_t n = size();
+    if (threads <= 1 || n < 2 * (size_t)threads) return kernel(0, n);
+    vector<T> partial(threads);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+      size_t begin = n * t / threads, end = n * (t + 1) / threads;
+      workers.push_back(thread([&partial, &kernel, t, begin, end] {
+        partial[t] = kernel(begin, end);
+      }));
+    }
+    T total = T();
+    for (int t = 0; t < threads; t++) {
+      workers[t].join();
+      total += partial[t];
+    }
+    return total;
+  }
 };
 
-void Goods::show() const {
-  cout << "name: " << _name << endl;
-  cout << "price: " << _price << endl;
-  cout << "amount: " << _amount << endl;
-  _date.show();
+
+// Snapshot file layout, all little-endian: the header, then each column in
+// the order listed, every one starting at a multiple of 8 bytes. The offsets
+// in the header are from the start of the file.
+struct SnapshotHeader {
+  char magic[8];  // "GOODSNAP"
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t rows;
+  uint64_t names;
+  uint64_t nameOffsets;  // uint64_t[names + 1], into nameText
+  uint64_t nameText;     // Names, each followed by '\0'
+  uint64_t nameIds;      // int32_t[rows]
+  uint64_t prices;       // double[rows]
+  uint64_t amounts;      // int32_t[rows]
+  uint64_t dates;        // int32_t[rows], Date::days()
+  uint64_t fileSize;
+  uint64_t checksum;  // FNV-1a over every byte after the header
 };
 
-static void Goods::showCounts() { cout << "Counts: " << _count << endl; }
+const uint32_t SNAPSHOT_VERSION = 2;  // 2: dates are days since 1970
 
-class Date {
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t h) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ p[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+const uint64_t FNV_BASIS = 14695981039346656037ull;
+
+// Streams columns to a file one after another, then goes back and fills in
+// the header once every offset and the checksum are known
+class SnapshotWriter {
  public:
-  Date(int y, int m, int d) {
-    _year = y;
-    _month = m;
-    _date = d;
+  SnapshotWriter() : _file(nullptr), _offset(0), _checksum(FNV_BASIS) {
+    memset(&_header, 0, sizeof(_header));
   }
 
-  void show() { cout << _year << "/" << _month << "/" << _day << endl; }
+  ~SnapshotWriter() {
+    if (_file != nullptr) fclose(_file);
+  }
 
-  void show() const { cout << _year << "/" << _month << "/" << _day << endl; }
+  bool open(const char *path, uint64_t rows, uint64_t names) {
+    _file = fopen(path, "wb");
+    if (_file == nullptr) return false;
+    memcpy(_header.magic, "GOODSNAP", 8);
+    _header.version = SNAPSHOT_VERSION;
+    _header.headerSize = sizeof(SnapshotHeader);
+    _header.rows = rows;
+    _header.names = names;
+    _offset = sizeof(SnapshotHeader);
+    return fwrite(&_header, sizeof(_header), 1, _file) == 1;
+  }
+
+  // Start a new column; returns its offset for the header
+  uint64_t beginColumn() {
+    static const char zeros[8] = {0};
+    write(zeros, (8 - _offset % 8) % 8);
+    return _offset;
+  }
+
+  bool write(const void *data, size_t size) {
+    if (size == 0) return true;
+    _checksum = fnv1a(data, size, _checksum);
+    _offset += size;
+    return fwrite(data, size, 1, _file) == 1;
+  }
+
+  SnapshotHeader &header() { return _header; }
+
+  bool finish() {
+    _header.fileSize = _offset;
+    _header.checksum = _checksum;
+    bool ok = fseek(_file, 0, SEEK_SET) == 0 &&
+              fwrite(&_header, sizeof(_header), 1, _file) == 1;
+    ok = fclose(_file) == 0 && ok;
+    _file = nullptr;
+    return ok;
+  }
+
+ private:
+  FILE *_file;
+  SnapshotHeader _header;
+  uint64_t _offset;
+  uint64_t _checksum;
+};
+
+bool Inventory::save(const char *path) const {
+  SnapshotWriter writer;
+  if (!writer.open(path, size(), _names.size())) return false;
+  SnapshotHeader &h = writer.header();
+  bool ok = true;
+
+  h.nameOffsets = writer.beginColumn();
+  uint64_t offset = 0;
+  for (const string &name : _names) {
+    ok = ok && writer.write(&offset, sizeof(offset));
+    offset += name.size() + 1;
+  }
+  ok = ok && writer.write(&offset, sizeof(offset));
+  h.nameText = writer.beginColumn();
+  for (const string &name : _names) {
+    ok = ok && writer.write(name.c_str(), name.size() + 1);
+  }
+
+  h.nameIds = writer.beginColumn();
+  ok = ok && writer.write(_name.data(), _name.size() * sizeof(int32_t));
+  h.prices = writer.beginColumn();
+  ok = ok && writer.write(_price.data(), _price.size() * sizeof(double));
+  h.amounts = writer.beginColumn();
+  ok = ok && writer.write(_amount.data(), _amount.size() * sizeof(int32_t));
+  h.dates = writer.beginColumn();
+  ok = ok && writer.write(_date.data(), _date.size() * sizeof(int32_t));
+  return writer.finish() && ok;
+}
+
+// A read-only view of a snapshot file mapped into memory. Opening only checks
+// the header and that the columns fit in the file; the columns are used in
+// place without being parsed or copied. Values in them are trusted except for
+// name ids and offsets, which getName() checks; verify() checks everything.
+class InventorySnapshot {
+ public:
+  InventorySnapshot() : _data(nullptr), _size(0) {}
+
+  ~InventorySnapshot() { close(); }
+
+  InventorySnapshot(const InventorySnapshot &) = delete;
+  InventorySnapshot &operator=(const InventorySnapshot &) = delete;
+
+  bool open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotHeader)) {
+      void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        _data = (const char *)p;
+        _size = st.st_size;
+      }
+    }
+    ::close(fd);
+    if (_data != nullptr && valid()) return true;
+    close();
+    return false;
+  }
+
+  void close() {
+    if (_data != nullptr) munmap((void *)_data, _size);
+    _data = nullptr;
+    _size = 0;
+  }
+
+  // Reads the whole file, so it is kept out of open()
+  bool verify() const {
+    return fnv1a(_data + sizeof(SnapshotHeader),
+                 _size - sizeof(SnapshotHeader),
+                 FNV_BASIS) == header().checksum;
+  }
+
+  size_t size() const { return header().rows; }
+
+  // nullptr for a row past the end or a corrupt name entry
+  const char *getName(size_t row) const {
+    const SnapshotHeader &h = header();
+    if (row >= h.rows) return nullptr;
+    uint32_t id = nameIds()[row];
+    if (id >= h.names) return nullptr;
+    const uint64_t *offsets = column<uint64_t>(h.nameOffsets);
+    uint64_t begin = offsets[id], end = offsets[id + 1];
+    // The name and its '\0' must lie inside nameText and the mapping
+    if (begin >= end || end > _size - h.nameText) return nullptr;
+    const char *name = _data + h.nameText + begin;
+    if (name[end - begin - 1] != '\0') return nullptr;
+    return name;
+  }
+
+  const int32_t *nameIds() const { return column<int32_t>(header().nameIds); }
+  const double *prices() const { return column<double>(header().prices); }
+  const int32_t *amounts() const { return column<int32_t>(header().amounts); }
+  const int32_t *dates() const { return column<int32_t>(header().dates); }
 
  private:
-  int _yead;
-  int _month;
-  int _date;
-}
\ No newline at end of file
+  const char *_data;
+  size_t _size;
+
+  const SnapshotHeader &header() const {
+    return *(const SnapshotHeader *)_data;
+  }
+
+  template <typename T>
+  const T *column(uint64_t offset) const {
+    return (const T *)(_data + offset);
+  }
+
+  bool fits(uint64_t offset, uint64_t bytes) const {
+    return offset % 8 == 0 && offset <= _size && bytes <= _size - offset;
+  }
+
+  bool valid() const {
+    const SnapshotHeader &h = header();
+    uint64_t rows = h.rows, names = h.names;
+    return memcmp(h.magic, "GOODSNAP", 8) == 0 &&
+           h.version == SNAPSHOT_VERSION &&
+           h.headerSize == sizeof(SnapshotHeader) && h.fileSize == _size &&
+           rows <= _size && names <= _size &&
+           fits(h.nameOffsets, (names + 1) * sizeof(uint64_t)) &&
+           h.nameText <= _size && fits(h.nameIds, rows * sizeof(int32_t)) &&
+           fits(h.prices, rows * sizeof(double)) &&
+           fits(h.amounts, rows * sizeof(int32_t)) &&
+           fits(h.dates, rows * sizeof(int32_t));
+  }
+};
\ No newline at end of file
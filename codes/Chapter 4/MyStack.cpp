@@ -1,59 +1,125 @@
+#include <stdlib.h>
+
+#include <utility>
+
 template <typename T>
+class Allocator {
+ public:
+  T *allocate(size_t size) { return (T *)malloc(sizeof(T) * size); }
+
+  void deallocate(void *p) { free(p); }
+
+  template <typename... Args>
+  void construct(T *p, Args &&...args) {
+    new (p) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T *p) { p->~T(); }
+};
+
+template <typename T, typename Alloc = Allocator<T>>
 class MyStack {
  public:
-  MyStack(int size = 10) : _pstack(new T[size]), _top(0), _size(size) {}
+  MyStack(int size = 10)
+      : _pstack(_allocator.allocate(size)), _top(0), _size(size) {}
 
   ~MyStack() {
-    delete[] _pstack;
+    clear();
+    _allocator.deallocate(_pstack);
     _pstack = nullptr;
   }
 
-  MyStack(const MyStack<T> &other) : _top(other.top), _size(other._size) {
-    _pstack = new T[_size];
-    for (int i = 0; i < _top; i++) {
-      _pstack[i] = other._pstack[i];
+  MyStack(const MyStack<T, Alloc> &other) : _top(0), _size(other._size) {
+    _pstack = _allocator.allocate(_size);
+    for (; _top < other._top; _top++) {
+      _allocator.construct(_pstack + _top, other._pstack[_top]);
     }
   }
 
-  MyStack<T> &operator=(const MyStack<T> &other) {
-    if (*this == other) return *this;
-    delete[] _pstack;
-    _top = other.top;
+  MyStack(MyStack<T, Alloc> &&other)
+      : _pstack(other._pstack), _top(other._top), _size(other._size) {
+    other._pstack = nullptr;
+    other._top = other._size = 0;
+  }
+
+  MyStack<T, Alloc> &operator=(const MyStack<T, Alloc> &other) {
+    if (this == &other) return *this;
+    clear();
+    _allocator.deallocate(_pstack);
     _size = other._size;
-    _pstack = new T[_size];
-    for (int i = 0; i < _top; i++) {
-      _pstack[i] = other._pstack[i];
+    _pstack = _allocator.allocate(_size);
+    for (; _top < other._top; _top++) {
+      _allocator.construct(_pstack + _top, other._pstack[_top]);
     }
     return *this;
   }
 
-  void push(const T &val) {
-    if (full()) resize();
-    _pstack[_top++] = val;
+  MyStack<T, Alloc> &operator=(MyStack<T, Alloc> &&other) {
+    if (this == &other) return *this;
+    clear();
+    _allocator.deallocate(_pstack);
+    _pstack = other._pstack;
+    _top = other._top;
+    _size = other._size;
+    other._pstack = nullptr;
+    other._top = other._size = 0;
+    return *this;
+  }
+
+  void push(const T &val) { emplace(val); }
+
+  void push(T &&val) { emplace(std::move(val)); }
+
+  // Construct the new element directly in the stack's storage. When growing,
+  // it is built in the new buffer before the old elements move, so args may
+  // refer to an element of this stack.
+  template <typename... Args>
+  T &emplace(Args &&...args) {
+    if (full()) {
+      int size = _size > 0 ? _size * 2 : 1;
+      T *tmp = _allocator.allocate(size);
+      _allocator.construct(tmp + _top, std::forward<Args>(args)...);
+      moveTo(tmp, size);
+    } else {
+      _allocator.construct(_pstack + _top, std::forward<Args>(args)...);
+    }
+    return _pstack[_top++];
   }
 
   void pop() {
-    if (!empty()) --_top;
+    if (!empty()) _allocator.destroy(_pstack + --_top);
   }
 
-  T top() const { return _pstack[_top - 1]; }
+  T &top() { return _pstack[_top - 1]; }
+
+  const T &top() const { return _pstack[_top - 1]; }
 
   bool full() const { return _top == _size; }
 
   bool empty() const { return _top == 0; }
 
+  int size() const { return _top; }
+
  private:
   T *_pstack;
   int _top;
   int _size;
+  Alloc _allocator;
+
+  void clear() {
+    while (_top > 0) {
+      _allocator.destroy(_pstack + --_top);
+    }
+  }
 
-  void resize() {
-    T *tmp = new T[_size * 2];
+  // Elements are moved, not copied, into the larger buffer
+  void moveTo(T *tmp, int size) {
     for (int i = 0; i < _top; i++) {
-      tmp[i] = _pstack[i];
+      _allocator.construct(tmp + i, std::move_if_noexcept(_pstack[i]));
+      _allocator.destroy(_pstack + i);
     }
-    delete[] _pstack;
+    _allocator.deallocate(_pstack);
     _pstack = tmp;
-    _size *= 2;
+    _size = size;
   }
-};
\ No newline at end of file
+};
@@ -1,50 +1,434 @@
+#include <math.h>
+#include <stddef.h>
+
 #include <iostream>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
 
-class MyComplex {
+// Everything but abs() and the stream operators is constexpr (C++14), so
+// arithmetic on constant operands folds at compile time
+template <typename T>
+class BasicComplex {
  public:
-  MyComplex(int r = 0, int i = 0) : mreal(r), mimage(i) {}
+  constexpr BasicComplex(T r = 0, T i = 0) : mreal(r), mimage(i) {}
 
-  MyComplex operator+(const MyComplex &other) {
-    return MyComplex(this->mreal + other.mreal, this->mimage + other.mimage);
-  }
+  constexpr T real() const { return mreal; }
+  constexpr T imag() const { return mimage; }
+
+  constexpr BasicComplex conj() const { return BasicComplex(mreal, -mimage); }
 
-  MyComplex operator++(int) { return MyComplex(mreal++, mimage++); }
+  // Squared magnitude, exact for integers
+  constexpr T norm() const { return mreal * mreal + mimage * mimage; }
 
-  MyComplex &operator++() {
+  double abs() const { return hypot((double)mreal, (double)mimage); }
+
+  constexpr BasicComplex operator++(int) {
+    return BasicComplex(mreal++, mimage++);
+  }
+
+  constexpr BasicComplex &operator++() {
     mreal += 1;
     mimage += 1;
     return *this;
   }
 
-  void operator+=(const MyComplex &other) {
+  constexpr BasicComplex operator-() const {
+    return BasicComplex(-mreal, -mimage);
+  }
+
+  constexpr BasicComplex &operator+=(const BasicComplex &other) {
     mreal += other.mreal;
     mimage += other.mimage;
+    return *this;
+  }
+
+  constexpr BasicComplex &operator-=(const BasicComplex &other) {
+    mreal -= other.mreal;
+    mimage -= other.mimage;
+    return *this;
+  }
+
+  constexpr BasicComplex &operator*=(const BasicComplex &other) {
+    T r = mreal * other.mreal - mimage * other.mimage;
+    mimage = mreal * other.mimage + mimage * other.mreal;
+    mreal = r;
+    return *this;
+  }
+
+  // Integer division truncates each part, like int division does
+  constexpr BasicComplex &operator/=(const BasicComplex &other) {
+    T d = other.norm();
+    T r = (mreal * other.mreal + mimage * other.mimage) / d;
+    mimage = (mimage * other.mreal - mreal * other.mimage) / d;
+    mreal = r;
+    return *this;
+  }
+
+ private:
+  T mreal;
+  T mimage;
+
+  // Non-member so that a number converts on either side: 20 + c, c + 20
+  friend constexpr BasicComplex operator+(BasicComplex c1,
+                                          const BasicComplex &c2) {
+    return c1 += c2;
+  }
+
+  friend constexpr BasicComplex operator-(BasicComplex c1,
+                                          const BasicComplex &c2) {
+    return c1 -= c2;
+  }
+
+  friend constexpr BasicComplex operator*(BasicComplex c1,
+                                          const BasicComplex &c2) {
+    return c1 *= c2;
+  }
+
+  friend constexpr BasicComplex operator/(BasicComplex c1,
+                                          const BasicComplex &c2) {
+    return c1 /= c2;
+  }
+
+  friend constexpr bool operator==(const BasicComplex &c1,
+                                   const BasicComplex &c2) {
+    return c1.mreal == c2.mreal && c1.mimage == c2.mimage;
+  }
+
+  // Works with std::ostream and with any buffer that takes numbers and text
+  template <typename Stream>
+  friend auto operator<<(Stream &out, const BasicComplex &c)
+      -> decltype(out << "") {
+    return out << c.mreal << "+" << c.mimage << "i";
+  }
+
+  friend std::istream &operator>>(std::istream &in, BasicComplex &c) {
+    return in >> c.mreal >> c.mimage;
+  }
+};
+
+using MyComplex = BasicComplex<int>;
+
+// Vector registers of floats, as wide as the target allows; the kernels below
+// are written once against these and fall back to plain floats without SIMD
+#if defined(__AVX__)
+typedef __m256 vfloat;
+const int LANES = 8;
+inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vzero() { return _mm256_setzero_ps(); }
+#elif defined(__SSE__) || defined(_M_X64)
+typedef __m128 vfloat;
+const int LANES = 4;
+inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vzero() { return _mm_setzero_ps(); }
+#else
+typedef float vfloat;
+const int LANES = 1;
+inline vfloat vload(const float *p) { return *p; }
+inline void vstore(float *p, vfloat v) { *p = v; }
+inline vfloat vadd(vfloat a, vfloat b) { return a + b; }
+inline vfloat vsub(vfloat a, vfloat b) { return a - b; }
+inline vfloat vmul(vfloat a, vfloat b) { return a * b; }
+inline vfloat vzero() { return 0; }
+#endif
+
+// Base of every array expression. Arithmetic on arrays builds a tree of
+// these instead of computing anything; assigning the tree to a ComplexArray
+// evaluates it element by element in one loop, with no temporary arrays.
+template <typename E>
+struct ComplexExpr {
+  const E &self() const { return static_cast<const E &>(*this); }
+};
+
+// Complex floats stored as a structure of arrays, all real parts together and
+// all imaginary parts together, so the elementwise kernels map onto SIMD lanes
+class ComplexArray : public ComplexExpr<ComplexArray> {
+ public:
+  ComplexArray(size_t size = 0) : _real(size), _imag(size) {}
+
+  template <typename E>
+  ComplexArray(const ComplexExpr<E> &expr)
+      : _real(expr.self().size()), _imag(expr.self().size()) {
+    assign(expr.self());
+  }
+
+  // Elements are computed one at a time, so the expression may read this
+  // array too
+  template <typename E>
+  ComplexArray &operator=(const ComplexExpr<E> &expr) {
+    _real.resize(expr.self().size());
+    _imag.resize(expr.self().size());
+    assign(expr.self());
+    return *this;
+  }
+
+  BasicComplex<float> operator[](size_t i) const { return get(i); }
+
+  size_t size() const { return _real.size(); }
+
+  BasicComplex<float> get(size_t i) const {
+    return BasicComplex<float>(_real[i], _imag[i]);
+  }
+
+  void set(size_t i, const BasicComplex<float> &c) {
+    _real[i] = c.real();
+    _imag[i] = c.imag();
+  }
+
+  float *real() { return _real.data(); }
+  float *imag() { return _imag.data(); }
+  const float *real() const { return _real.data(); }
+  const float *imag() const { return _imag.data(); }
+
+ private:
+  std::vector<float> _real;
+  std::vector<float> _imag;
+
+  template <typename E>
+  void assign(const E &expr) {
+    for (size_t i = 0; i < _real.size(); i++) {
+      BasicComplex<float> c = expr[i];
+      _real[i] = c.real();
+      _imag[i] = c.imag();
+    }
+  }
+};
+
+// A single complex number used as an array of identical elements
+class ComplexScalar : public ComplexExpr<ComplexScalar> {
+ public:
+  ComplexScalar(const BasicComplex<float> &c) : _c(c) {}
+  BasicComplex<float> operator[](size_t) const { return _c; }
+  size_t size() const { return (size_t)-1; }
+
+ private:
+  BasicComplex<float> _c;
+};
+
+struct AddOp {
+  template <typename T>
+  static constexpr T apply(const T &a, const T &b) { return a + b; }
+};
+
+struct SubOp {
+  template <typename T>
+  static constexpr T apply(const T &a, const T &b) { return a - b; }
+};
+
+struct MulOp {
+  template <typename T>
+  static constexpr T apply(const T &a, const T &b) { return a * b; }
+};
+
+struct DivOp {
+  template <typename T>
+  static constexpr T apply(const T &a, const T &b) { return a / b; }
+};
+
+// Arrays are held by reference, everything else (short-lived subexpressions
+// and scalars) by value
+template <typename E>
+struct ExprStorage {
+  typedef E type;
+};
+
+template <>
+struct ExprStorage<ComplexArray> {
+  typedef const ComplexArray &type;
+};
+
+template <typename L, typename R, typename Op>
+class BinaryExpr : public ComplexExpr<BinaryExpr<L, R, Op>> {
+ public:
+  BinaryExpr(const L &l, const R &r) : _l(l), _r(r) {}
+  BasicComplex<float> operator[](size_t i) const {
+    return Op::apply(_l[i], _r[i]);
+  }
+  // The shorter side decides; scalars count as endless
+  size_t size() const {
+    return _l.size() < _r.size() ? _l.size() : _r.size();
   }
 
  private:
-  int mreal;
-  int mimage;
-  friend MyComplex operator+(const MyComplex &c1, const MyComplex &c2);
-  friend std::ostream &operator<<(std::ostream &out, const MyComplex &c);
-  friend std::istream &operator>>(std::istream &in, MyComplex &c);
+  typename ExprStorage<L>::type _l;
+  typename ExprStorage<R>::type _r;
 };
 
-MyComplex operator+(const MyComplex &c1, const MyComplex &c2) {
-  return MyComplex(c1.mreal + c2.mreal, c1.mimage + c2.mimage);
+template <typename L, typename R>
+BinaryExpr<L, R, AddOp> operator+(const ComplexExpr<L> &l,
+                                  const ComplexExpr<R> &r) {
+  return BinaryExpr<L, R, AddOp>(l.self(), r.self());
+}
+
+template <typename L, typename R>
+BinaryExpr<L, R, SubOp> operator-(const ComplexExpr<L> &l,
+                                  const ComplexExpr<R> &r) {
+  return BinaryExpr<L, R, SubOp>(l.self(), r.self());
+}
+
+template <typename L, typename R>
+BinaryExpr<L, R, MulOp> operator*(const ComplexExpr<L> &l,
+                                  const ComplexExpr<R> &r) {
+  return BinaryExpr<L, R, MulOp>(l.self(), r.self());
+}
+
+template <typename L, typename R>
+BinaryExpr<L, R, DivOp> operator/(const ComplexExpr<L> &l,
+                                  const ComplexExpr<R> &r) {
+  return BinaryExpr<L, R, DivOp>(l.self(), r.self());
+}
+
+// Mixing arrays with a scalar: a * 2.0f, c + a
+
+template <typename L>
+BinaryExpr<L, ComplexScalar, AddOp> operator+(const ComplexExpr<L> &l,
+                                              const BasicComplex<float> &r) {
+  return l + ComplexScalar(r);
+}
+
+template <typename R>
+BinaryExpr<ComplexScalar, R, AddOp> operator+(const BasicComplex<float> &l,
+                                              const ComplexExpr<R> &r) {
+  return ComplexScalar(l) + r;
+}
+
+template <typename L>
+BinaryExpr<L, ComplexScalar, SubOp> operator-(const ComplexExpr<L> &l,
+                                              const BasicComplex<float> &r) {
+  return l - ComplexScalar(r);
+}
+
+template <typename R>
+BinaryExpr<ComplexScalar, R, SubOp> operator-(const BasicComplex<float> &l,
+                                              const ComplexExpr<R> &r) {
+  return ComplexScalar(l) - r;
+}
+
+template <typename L>
+BinaryExpr<L, ComplexScalar, MulOp> operator*(const ComplexExpr<L> &l,
+                                              const BasicComplex<float> &r) {
+  return l * ComplexScalar(r);
+}
+
+template <typename R>
+BinaryExpr<ComplexScalar, R, MulOp> operator*(const BasicComplex<float> &l,
+                                              const ComplexExpr<R> &r) {
+  return ComplexScalar(l) * r;
+}
+
+template <typename L>
+BinaryExpr<L, ComplexScalar, DivOp> operator/(const ComplexExpr<L> &l,
+                                              const BasicComplex<float> &r) {
+  return l / ComplexScalar(r);
+}
+
+template <typename R>
+BinaryExpr<ComplexScalar, R, DivOp> operator/(const BasicComplex<float> &l,
+                                              const ComplexExpr<R> &r) {
+  return ComplexScalar(l) / r;
+}
+
+// All kernels work on the elements all three arrays have, leaving any others
+// in the output alone; out may be the same array as an input
+
+inline size_t commonSize(const ComplexArray &a, const ComplexArray &b,
+                         const ComplexArray &out) {
+  size_t n = a.size() < b.size() ? a.size() : b.size();
+  return n < out.size() ? n : out.size();
 }
 
-std::ostream &operator<<(std::ostream &out, const MyComplex &c) {
-  return out << c.mreal << "+" << c.mimage << "i";
+// out = a + b
+void add(const ComplexArray &a, const ComplexArray &b, ComplexArray &out) {
+  size_t n = commonSize(a, b, out), i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    vstore(out.real() + i, vadd(vload(a.real() + i), vload(b.real() + i)));
+    vstore(out.imag() + i, vadd(vload(a.imag() + i), vload(b.imag() + i)));
+  }
+  for (; i < n; i++) {
+    out.real()[i] = a.real()[i] + b.real()[i];
+    out.imag()[i] = a.imag()[i] + b.imag()[i];
+  }
 }
 
-std::istream &operator>>(std::istream &in, MyComplex &c) {
-  return in >> c.mreal >> c.mimage;
+// out = a * b
+void mul(const ComplexArray &a, const ComplexArray &b, ComplexArray &out) {
+  size_t n = commonSize(a, b, out), i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    vfloat ar = vload(a.real() + i), ai = vload(a.imag() + i);
+    vfloat br = vload(b.real() + i), bi = vload(b.imag() + i);
+    vstore(out.real() + i, vsub(vmul(ar, br), vmul(ai, bi)));
+    vstore(out.imag() + i, vadd(vmul(ar, bi), vmul(ai, br)));
+  }
+  for (; i < n; i++) {
+    float ar = a.real()[i], ai = a.imag()[i];
+    float br = b.real()[i], bi = b.imag()[i];
+    out.real()[i] = ar * br - ai * bi;
+    out.imag()[i] = ar * bi + ai * br;
+  }
+}
+
+// acc += a * b
+void mac(const ComplexArray &a, const ComplexArray &b, ComplexArray &acc) {
+  size_t n = commonSize(a, b, acc), i = 0;
+  for (; i + LANES <= n; i += LANES) {
+    vfloat ar = vload(a.real() + i), ai = vload(a.imag() + i);
+    vfloat br = vload(b.real() + i), bi = vload(b.imag() + i);
+    vfloat re = vsub(vmul(ar, br), vmul(ai, bi));
+    vfloat im = vadd(vmul(ar, bi), vmul(ai, br));
+    vstore(acc.real() + i, vadd(vload(acc.real() + i), re));
+    vstore(acc.imag() + i, vadd(vload(acc.imag() + i), im));
+  }
+  for (; i < n; i++) {
+    float ar = a.real()[i], ai = a.imag()[i];
+    float br = b.real()[i], bi = b.imag()[i];
+    acc.real()[i] += ar * br - ai * bi;
+    acc.imag()[i] += ar * bi + ai * br;
+  }
+}
+
+// Sum of a[i] * b[i] over the shorter of the two arrays, without conjugation
+BasicComplex<float> dot(const ComplexArray &a, const ComplexArray &b) {
+  size_t n = a.size() < b.size() ? a.size() : b.size(), i = 0;
+  vfloat sr = vzero(), si = vzero();
+  for (; i + LANES <= n; i += LANES) {
+    vfloat ar = vload(a.real() + i), ai = vload(a.imag() + i);
+    vfloat br = vload(b.real() + i), bi = vload(b.imag() + i);
+    sr = vadd(sr, vsub(vmul(ar, br), vmul(ai, bi)));
+    si = vadd(si, vadd(vmul(ar, bi), vmul(ai, br)));
+  }
+  float lanes[2][LANES];
+  vstore(lanes[0], sr);
+  vstore(lanes[1], si);
+  float re = 0, im = 0;
+  for (int l = 0; l < LANES; l++) {
+    re += lanes[0][l];
+    im += lanes[1][l];
+  }
+  for (; i < n; i++) {
+    float ar = a.real()[i], ai = a.imag()[i];
+    float br = b.real()[i], bi = b.imag()[i];
+    re += ar * br - ai * bi;
+    im += ar * bi + ai * br;
+  }
+  return BasicComplex<float>(re, im);
 }
 
 int main() {
   MyComplex c1;
   MyComplex c2;
   std::cin >> c1 >> c2;
-  std::cout << c1 << " " << c2 << std::endl;
+  std::cout << c1 << " " << c2 << "\n";
   return 0;
-}
\ No newline at end of file
+}
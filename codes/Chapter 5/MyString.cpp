@@ -72,7 +72,8 @@ class MyString {
 
  private:
   char *_pstr;
-  friend std::ostream &operator<<(std::ostream &out, const MyString s);
+  template <typename Stream>
+  friend auto operator<<(Stream &out, const MyString &s) -> decltype(out << "");
   friend MyString operator+(const MyString &s1, const MyString &s2);
 };
 
@@ -84,6 +85,8 @@ MyString operator+(const MyString &s1, const MyString &s2) {
   return tmp;
 }
 
-std::ostream &operator<<(std::ostream &out, const MyString s) {
+// Works with std::ostream and with any buffer that takes const char *
+template <typename Stream>
+auto operator<<(Stream &out, const MyString &s) -> decltype(out << "") {
   return out << s._pstr;
 }
\ No newline at end of file
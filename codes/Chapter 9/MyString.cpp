@@ -15,7 +15,7 @@ class MyString {
   }
 
   ~MyString() {
-    delete _pstr;
+    delete[] _pstr;
     _pstr = nullptr;
   }
 
@@ -25,7 +25,7 @@ class MyString {
   }
 
   MyString(MyString &&other) {
-    _pstr = other._ptr;
+    _pstr = other._pstr;
     other._pstr = nullptr;
   }
 
@@ -39,9 +39,9 @@ class MyString {
 
   MyString &operator=(MyString &&other) {
     if (this == &other) return *this;
-    delete[] mptr;
+    delete[] _pstr;
     _pstr = other._pstr;
-    other._pstr = null;
+    other._pstr = nullptr;
     return *this;
   }
 
@@ -85,18 +85,22 @@ class MyString {
 
  private:
   char *_pstr;
-  friend std::ostream &operator<<(std::ostream &out, const MyString s);
+  template <typename Stream>
+  friend auto operator<<(Stream &out, const MyString &s) -> decltype(out << "");
   friend MyString operator+(const MyString &s1, const MyString &s2);
 };
 
 MyString operator+(const MyString &s1, const MyString &s2) {
   MyString tmp;
+  delete[] tmp._pstr;
   tmp._pstr = new char[strlen(s1._pstr) + strlen(s2._pstr) + 1];
   strcpy(tmp._pstr, s1._pstr);
   strcat(tmp._pstr, s2._pstr);
   return tmp;
 }
 
-std::ostream &operator<<(std::ostream &out, const MyString s) {
+// Works with std::ostream and with any buffer that takes const char *
+template <typename Stream>
+auto operator<<(Stream &out, const MyString &s) -> decltype(out << "") {
   return out << s._pstr;
 }
\ No newline at end of file